@@ -3,7 +3,26 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/trace.h"
+
+/*! Request latency histogram buckets. Bucket 0 counts requests which took
+    fewer than 2^(BLOCK_HIST_SHIFT + 1) cycles, bucket I > 0 those which took
+    from 2^(I + BLOCK_HIST_SHIFT) up to 2^(I + BLOCK_HIST_SHIFT + 1) cycles,
+    except that the last bucket has no upper bound. */
+#define BLOCK_HIST_BUCKETS 12
+#define BLOCK_HIST_SHIFT 14
+
+/*! Statistics for requests in one direction on a block device. */
+typedef struct block_io_stats {
+    unsigned long long requests;        /*!< Number of requests. */
+    unsigned long long sequential;      /*!< ...which began at the sector
+                                             after the device's previous
+                                             request. */
+    unsigned long long cycles;          /*!< Total request latency. */
+    unsigned hist[BLOCK_HIST_BUCKETS];  /*!< Latency histogram, in cycles. */
+} block_io_stats_t;
 
 /*! A block device. */
 typedef struct block {
@@ -18,6 +37,14 @@ typedef struct block {
 
     unsigned long long read_cnt;        /*!< Number of sectors read. */
     unsigned long long write_cnt;       /*!< Number of sectors written. */
+
+    /* Request statistics, updated with interrupts off. */
+    block_io_stats_t io[2];             /*!< Reads, then writes. */
+    block_sector_t next_sector;         /*!< Sector after the last request. */
+    unsigned in_flight;                 /*!< Requests under way. */
+    unsigned max_in_flight;             /*!< Most requests under way. */
+    unsigned long long depth_sum;       /*!< Sum over requests of the number
+                                             under way when each began. */
 } block_t;
 
 /*! List of all block devices. */
@@ -93,14 +120,61 @@ static void check_sector(block_t *block, block_sector_t sector) {
     }
 }
 
+/*! Starts accounting for a request to BLOCK which reads, or writes if
+    WRITE, the CNT sectors starting at SECTOR. Returns the time the request
+    began, to pass to request_end(). */
+static uint64_t request_begin(block_t *block, bool write,
+                              block_sector_t sector, size_t cnt) {
+    TRACE(write ? TRACE_BLOCK_WRITE : TRACE_BLOCK_READ, block->name, sector,
+          cnt);
+
+    enum intr_level old_level = intr_disable();
+    block_io_stats_t *io = &block->io[write];
+    io->requests++;
+    if (sector == block->next_sector) io->sequential++;
+    block->next_sector = sector + cnt;
+    block->depth_sum += block->in_flight;
+    if (++block->in_flight > block->max_in_flight) {
+        block->max_in_flight = block->in_flight;
+    }
+    intr_set_level(old_level);
+    return rdtsc();
+}
+
+/*! Finishes accounting for a request begun by request_begin() at START. */
+static void request_end(block_t *block, bool write, block_sector_t sector,
+                        size_t cnt, uint64_t start) {
+    uint64_t cycles = rdtsc() - start;
+    size_t b = 0;
+    while (b < BLOCK_HIST_BUCKETS - 1
+           && cycles >= (2ULL << (b + BLOCK_HIST_SHIFT))) {
+        b++;
+    }
+
+    enum intr_level old_level = intr_disable();
+    block_io_stats_t *io = &block->io[write];
+    io->cycles += cycles;
+    io->hist[b]++;
+    block->in_flight--;
+    if (write) {
+        block->write_cnt += cnt;
+    } else {
+        block->read_cnt += cnt;
+    }
+    intr_set_level(old_level);
+
+    TRACE(TRACE_BLOCK_COMPLETE, block->name, sector, cnt);
+}
+
 /*! Reads sector SECTOR from BLOCK into BUFFER, which must
     have room for BLOCK_SECTOR_SIZE bytes.
     Internally synchronizes accesses to block devices, so external
     per-block device locking is unneeded. */
 void block_read(block_t *block, block_sector_t sector, void *buffer) {
     check_sector(block, sector);
+    uint64_t start = request_begin(block, false, sector, 1);
     block->ops->read(block->aux, sector, buffer);
-    block->read_cnt++;
+    request_end(block, false, sector, 1, start);
 }
 
 /*! Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -112,8 +186,83 @@ void block_write(block_t *block, block_sector_t sector,
                  const void *buffer) {
     check_sector(block, sector);
     ASSERT(block->type != BLOCK_FOREIGN);
+    uint64_t start = request_begin(block, true, sector, 1);
     block->ops->write(block->aux, sector, buffer);
-    block->write_cnt++;
+    request_end(block, true, sector, 1, start);
+}
+
+/*! Reads CNT consecutive sectors starting at SECTOR from BLOCK into BUFFER,
+    which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  If the driver
+    supports it, the whole range is moved by a single multi-sector command.
+    Internally synchronizes accesses to block devices, so external
+    per-block device locking is unneeded. */
+void block_read_multiple(block_t *block, block_sector_t sector, size_t cnt,
+                         void *buffer) {
+    block_read_vector(block, sector, 1, cnt, &buffer);
+}
+
+/*! Writes CNT consecutive sectors starting at SECTOR to BLOCK from BUFFER,
+    which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns after the
+    block device has acknowledged receiving all of the data.
+    Internally synchronizes accesses to block devices, so external
+    per-block device locking is unneeded. */
+void block_write_multiple(block_t *block, block_sector_t sector, size_t cnt,
+                          const void *buffer) {
+    block_write_vector(block, sector, 1, cnt, &buffer);
+}
+
+/*! Reads BUF_CNT * BUF_SECTORS consecutive sectors starting at SECTOR from
+    BLOCK into the BUF_CNT buffers in BUFFERS, each of which must have room
+    for BUF_SECTORS * BLOCK_SECTOR_SIZE bytes, so that scattered pages can be
+    filled without copying.  If the driver supports it, the whole range is
+    moved by a single multi-sector command.  Internally synchronizes accesses
+    to block devices, so external per-block device locking is unneeded. */
+void block_read_vector(block_t *block, block_sector_t sector, size_t buf_cnt,
+                       size_t buf_sectors, void *const *buffers) {
+    size_t cnt = buf_cnt * buf_sectors;
+    if (cnt == 0) return;
+    check_sector(block, sector);
+    check_sector(block, sector + cnt - 1);
+    uint64_t start = request_begin(block, false, sector, cnt);
+    if (block->ops->read_vector != NULL) {
+        block->ops->read_vector(block->aux, sector, cnt, buffers,
+                                buf_sectors);
+    } else {
+        for (size_t i = 0; i < cnt; i++) {
+            block->ops->read(block->aux, sector + i,
+                             buffers[i / buf_sectors]
+                             + i % buf_sectors * BLOCK_SECTOR_SIZE);
+        }
+    }
+    request_end(block, false, sector, cnt, start);
+}
+
+/*! Writes BUF_CNT * BUF_SECTORS consecutive sectors starting at SECTOR to
+    BLOCK from the BUF_CNT buffers in BUFFERS, each of which must contain
+    BUF_SECTORS * BLOCK_SECTOR_SIZE bytes.  Returns after the block device
+    has acknowledged receiving all of the data.  Internally synchronizes
+    accesses to block devices, so external per-block device locking is
+    unneeded. */
+void block_write_vector(block_t *block, block_sector_t sector,
+                        size_t buf_cnt, size_t buf_sectors,
+                        const void *const *buffers) {
+    size_t cnt = buf_cnt * buf_sectors;
+    if (cnt == 0) return;
+    check_sector(block, sector);
+    check_sector(block, sector + cnt - 1);
+    ASSERT(block->type != BLOCK_FOREIGN);
+    uint64_t start = request_begin(block, true, sector, cnt);
+    if (block->ops->write_vector != NULL) {
+        block->ops->write_vector(block->aux, sector, cnt, buffers,
+                                 buf_sectors);
+    } else {
+        for (size_t i = 0; i < cnt; i++) {
+            block->ops->write(block->aux, sector + i,
+                              buffers[i / buf_sectors]
+                              + i % buf_sectors * BLOCK_SECTOR_SIZE);
+        }
+    }
+    request_end(block, true, sector, cnt, start);
 }
 
 /*! Returns the number of sectors in BLOCK. */
@@ -131,6 +280,68 @@ enum block_type block_type(block_t *block) {
     return block->type;
 }
 
+/*! Formats the statistics of BLOCK into the SIZE bytes of BUF: a line
+    with its sector counts, then, for each direction it has had requests in,
+    a line describing them, and a line describing its queue depth. Returns
+    the number of bytes written, not counting the null terminator. */
+static size_t block_format(block_t *block, char *buf, size_t size) {
+    static const char *dirs[2] = { "reads", "writes" };
+    size_t len = 0;
+
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    len += snprintf(buf, size, "%s (%s): %llu reads, %llu writes\n",
+                    block->name, block_type_name(block->type),
+                    block->read_cnt, block->write_cnt);
+    for (int w = 0; w < 2 && len + 1 < size; w++) {
+        const block_io_stats_t *io = &block->io[w];
+        unsigned long long sectors = w ? block->write_cnt : block->read_cnt;
+        if (io->requests == 0) continue;
+
+        len += snprintf(buf + len, size - len, "%s (%s) %s: %llu requests, "
+                        "%llu bytes, %llu sequential, %llu avg cycles,",
+                        block->name, block_type_name(block->type), dirs[w],
+                        io->requests, sectors * BLOCK_SECTOR_SIZE,
+                        io->sequential, io->cycles / io->requests);
+        for (int b = 0; b < BLOCK_HIST_BUCKETS && len + 1 < size; b++) {
+            bool last = b == BLOCK_HIST_BUCKETS - 1;
+            if (io->hist[b] == 0) continue;
+            len += snprintf(buf + len, size - len, " %s2^%d:%u",
+                            last ? ">=" : "<", b + BLOCK_HIST_SHIFT + !last,
+                            io->hist[b]);
+        }
+        if (len + 1 < size) len += snprintf(buf + len, size - len, "\n");
+    }
+
+    unsigned long long requests = block->io[0].requests
+                                  + block->io[1].requests;
+    if (requests > 0 && len + 1 < size) {
+        unsigned long long avg = block->depth_sum * 100 / requests;
+        len += snprintf(buf + len, size - len, "%s (%s) queue: max depth %u, "
+                        "avg %llu.%02llu others under way\n", block->name,
+                        block_type_name(block->type), block->max_in_flight,
+                        avg / 100, avg % 100);
+    }
+    return len < size ? len : size - 1;
+}
+
+/*! Formats the statistics of each block device used for a Pintos role into
+    the SIZE bytes of BUF. Returns the number of bytes written, not counting
+    the null terminator. */
+size_t block_stats_format(char *buf, size_t size) {
+    size_t len = 0;
+
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    for (int i = 0; i < BLOCK_ROLE_CNT && len + 1 < size; i++) {
+        block_t *block = block_by_role[i];
+        if (block != NULL) {
+            len += block_format(block, buf + len, size - len);
+        }
+    }
+    return len;
+}
+
 /*! Prints statistics for each block device used for a Pintos role. */
 void block_print_stats(void) {
     int i;
@@ -138,9 +349,9 @@ void block_print_stats(void) {
     for (i = 0; i < BLOCK_ROLE_CNT; i++) {
         block_t *block = block_by_role[i];
         if (block != NULL) {
-            printf("%s (%s): %llu reads, %llu writes\n",
-                   block->name, block_type_name(block->type),
-                   block->read_cnt, block->write_cnt);
+            char buf[512];
+            block_format(block, buf, sizeof buf);
+            printf("%s", buf);
         }
     }
 }
@@ -164,6 +375,10 @@ block_t * block_register(const char *name, enum block_type type,
     block->aux = aux;
     block->read_cnt = 0;
     block->write_cnt = 0;
+    memset(block->io, 0, sizeof block->io);
+    block->next_sector = 0;
+    block->in_flight = block->max_in_flight = 0;
+    block->depth_sum = 0;
 
     printf("%s: %'"PRDSNu" sectors (", block->name, block->size);
     print_human_readable_size((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -52,17 +52,33 @@ block_t *block_next(block_t *);
 block_sector_t block_size(block_t *);
 void block_read(block_t *, block_sector_t, void *);
 void block_write(block_t *, block_sector_t, const void *);
+void block_read_multiple(block_t *, block_sector_t, size_t cnt, void *);
+void block_write_multiple(block_t *, block_sector_t, size_t cnt,
+                          const void *);
+void block_read_vector(block_t *, block_sector_t, size_t buf_cnt,
+                       size_t buf_sectors, void *const *buffers);
+void block_write_vector(block_t *, block_sector_t, size_t buf_cnt,
+                        size_t buf_sectors, const void *const *buffers);
 const char *block_name(block_t *);
 enum block_type block_type(block_t *);
 
 /* Statistics. */
+size_t block_stats_format(char *buf, size_t size);
 void block_print_stats(void);
 
 /* Lower-level interface to block device drivers. */
 
+/*! Driver operations. READ_VECTOR and WRITE_VECTOR transfer CNT
+    consecutive sectors with as few commands as possible, to or from
+    BUFFERS, each of which holds BUF_SECTORS of the sectors in turn; drivers
+    which leave them null get a sector-at-a-time fallback. */
 struct block_operations {
     void (*read)(void *aux, block_sector_t, void *buffer);
     void (*write)(void *aux, block_sector_t, const void *buffer);
+    void (*read_vector)(void *aux, block_sector_t, size_t cnt,
+                        void *const *buffers, size_t buf_sectors);
+    void (*write_vector)(void *aux, block_sector_t, size_t cnt,
+                         const void *const *buffers, size_t buf_sectors);
 };
 
 block_t *block_register(const char *name, enum block_type,
@@ -14,6 +14,7 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 
 /*! ATA command block port addresses. @{ */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)    /*!< Data. */
@@ -38,6 +39,7 @@
 #define STA_BSY 0x80            /*!< Busy. */
 #define STA_DRDY 0x40           /*!< Device Ready. */
 #define STA_DRQ 0x08            /*!< Data Request. */
+#define STA_ERR 0x01            /*!< Error. */
 /*! @} */
 
 /*! Control Register bits. @{ */
@@ -55,14 +57,27 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /*!< IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /*!< READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /*!< WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /*!< READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /*!< WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /*!< SET MULTIPLE MODE. */
 /*! @} */
 
+/*! Largest number of sectors moved by a single command.  (The sector count
+    register is 8 bits wide.) */
+#define MAX_COMMAND_SECTORS 255
+
+/*! Largest number of sectors we ask a disk to move per interrupt in
+    READ/WRITE MULTIPLE. */
+#define MAX_MULTIPLE 16
+
 /*! An ATA device. */
 struct ata_disk {
     char name[8];               /*!< Name, e.g. "hda". */
     struct channel *channel;    /*!< Channel that disk is attached to. */
     int dev_no;                 /*!< Device 0 or 1 for master or slave. */
     bool is_ata;                /*!< Is device an ATA disk? */
+    int multiple;               /*!< Sectors per interrupt with READ/WRITE
+                                     MULTIPLE, or 1 if unsupported. */
 };
 
 /*! An ATA channel (aka controller).
@@ -73,11 +88,19 @@ struct channel {
     uint8_t irq;                /*!< Interrupt in use. */
 
     lock_t lock;           /*!< Must acquire to access the controller. */
+    uint64_t acquired_at;       /*!< When the lock was last acquired. */
     bool expecting_interrupt;   /*!< True if an interrupt is expected, false if
                                      any interrupt would be spurious. */
     struct semaphore completion_wait;   /*!< Up'd by interrupt handler. */
 
     struct ata_disk devices[2];     /*!< The devices on this channel. */
+
+    /* Statistics, updated while holding the lock. */
+    unsigned long long acquires;    /*!< Times the lock was acquired. */
+    unsigned long long contended;   /*!< ...after waiting for another
+                                         thread. */
+    uint64_t wait_cycles;           /*!< Total cycles waiting for the lock. */
+    uint64_t hold_cycles;           /*!< Total cycles holding the lock. */
 };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -90,7 +113,8 @@ static void reset_channel(struct channel *);
 static bool check_device_type(struct ata_disk *);
 static void identify_ata_device(struct ata_disk *);
 
-static void select_sector(struct ata_disk *, block_sector_t);
+static void set_multiple_mode(struct ata_disk *, int max);
+static void select_sectors(struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command(struct channel *, uint8_t command);
 static void input_sector(struct channel *, void *);
 static void output_sector(struct channel *, const void *);
@@ -102,6 +126,9 @@ static void select_device_wait(const struct ata_disk *);
 
 static void interrupt_handler(struct intr_frame *);
 
+static void channel_acquire(struct channel *);
+static void channel_release(struct channel *);
+
 /*! Initialize the disk subsystem and detect disks. */
 void ide_init (void) {
     size_t chan_no;
@@ -125,6 +152,7 @@ void ide_init (void) {
             NOT_REACHED();
         }
         lock_init(&c->lock);
+        lock_set_name(&c->lock, c->name);
         c->expecting_interrupt = false;
         sema_init(&c->completion_wait, 0);
  
@@ -136,6 +164,7 @@ void ide_init (void) {
             d->channel = c;
             d->dev_no = dev_no;
             d->is_ata = false;
+            d->multiple = 1;
         }
 
         /* Register interrupt handler. */
@@ -285,6 +314,9 @@ static void identify_ata_device(struct ata_disk *d) {
         return;
     }
 
+    /* Transfer as many sectors per interrupt as the disk allows. */
+    set_multiple_mode(d, (uint8_t) id[47 * 2]);
+
     /* Register. */
     block = block_register(d->name, BLOCK_RAW, extra_info, capacity,
                          &ide_operations, d);
@@ -315,20 +347,105 @@ static char * descramble_ata_string(char *string, int size) {
     return string;
 }
 
+/*! Enables READ/WRITE MULTIPLE on disk D with the largest power of two
+    sectors per interrupt that is at most MAX and MAX_MULTIPLE.  Leaves
+    D->multiple at 1 if the disk does not support or rejects it. */
+static void set_multiple_mode(struct ata_disk *d, int max) {
+    struct channel *c = d->channel;
+    int cnt;
+
+    d->multiple = 1;
+    for (cnt = MAX_MULTIPLE; cnt > max; cnt /= 2)
+        continue;
+    if (cnt < 2)
+        return;
+
+    select_device_wait(d);
+    outb(reg_nsect(c), cnt);
+    issue_pio_command(c, CMD_SET_MULTIPLE_MODE);
+    sema_down(&c->completion_wait);
+    wait_while_busy(d);
+    if (!(inb(reg_alt_status(c)) & STA_ERR))
+        d->multiple = cnt;
+}
+
+/*! Reads CNT sectors starting at SEC_NO from disk D into BUFFERS, each of
+    which must have room for BUF_SECTORS * BLOCK_SECTOR_SIZE bytes.  Each
+    group of up to MAX_COMMAND_SECTORS sectors is moved by a single command,
+    with one interrupt per D->multiple sectors.  Internally synchronizes
+    accesses to disks, so external per-disk locking is unneeded. */
+static void ide_read_vector(void *d_, block_sector_t sec_no, size_t cnt,
+                            void *const *buffers, size_t buf_sectors) {
+    struct ata_disk *d = d_;
+    struct channel *c = d->channel;
+    size_t k = 0;
+    channel_acquire(c);
+    while (cnt > 0) {
+        size_t n = cnt < MAX_COMMAND_SECTORS ? cnt : MAX_COMMAND_SECTORS;
+        bool multiple = d->multiple > 1 && n > 1;
+        select_sectors(d, sec_no, n);
+        issue_pio_command(c, multiple ? CMD_READ_MULTIPLE
+                                      : CMD_READ_SECTOR_RETRY);
+        for (size_t done = 0; done < n; ) {
+            size_t blk = multiple ? (size_t) d->multiple : 1;
+            if (blk > n - done)
+                blk = n - done;
+            sema_down(&c->completion_wait);
+            if (!wait_while_busy(d))
+                PANIC("%s: disk read failed, sector=%"PRDSNu,
+                      d->name, sec_no + done);
+            for (size_t i = 0; i < blk; i++, k++)
+                input_sector(c, buffers[k / buf_sectors]
+                                + k % buf_sectors * BLOCK_SECTOR_SIZE);
+            done += blk;
+        }
+        sec_no += n;
+        cnt -= n;
+    }
+    channel_release(c);
+}
+
+/*! Writes CNT sectors starting at SEC_NO to disk D from BUFFERS, each of
+    which must contain BUF_SECTORS * BLOCK_SECTOR_SIZE bytes.  Returns after
+    the disk has acknowledged receiving all of the data.  Internally
+    synchronizes accesses to disks, so external per-disk locking is
+    unneeded. */
+static void ide_write_vector(void *d_, block_sector_t sec_no, size_t cnt,
+                             const void *const *buffers, size_t buf_sectors) {
+    struct ata_disk *d = d_;
+    struct channel *c = d->channel;
+    size_t k = 0;
+    channel_acquire(c);
+    while (cnt > 0) {
+        size_t n = cnt < MAX_COMMAND_SECTORS ? cnt : MAX_COMMAND_SECTORS;
+        bool multiple = d->multiple > 1 && n > 1;
+        select_sectors(d, sec_no, n);
+        issue_pio_command(c, multiple ? CMD_WRITE_MULTIPLE
+                                      : CMD_WRITE_SECTOR_RETRY);
+        for (size_t done = 0; done < n; ) {
+            size_t blk = multiple ? (size_t) d->multiple : 1;
+            if (blk > n - done)
+                blk = n - done;
+            if (!wait_while_busy(d))
+                PANIC("%s: disk write failed, sector=%"PRDSNu,
+                      d->name, sec_no + done);
+            for (size_t i = 0; i < blk; i++, k++)
+                output_sector(c, buffers[k / buf_sectors]
+                                 + k % buf_sectors * BLOCK_SECTOR_SIZE);
+            sema_down(&c->completion_wait);
+            done += blk;
+        }
+        sec_no += n;
+        cnt -= n;
+    }
+    channel_release(c);
+}
+
 /*! Reads sector SEC_NO from disk D into BUFFER, which must have room for
     BLOCK_SECTOR_SIZE bytes.  Internally synchronizes accesses to disks,
     so external per-disk locking is unneeded. */
 static void ide_read(void *d_, block_sector_t sec_no, void *buffer) {
-    struct ata_disk *d = d_;
-    struct channel *c = d->channel;
-    lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-    sema_down(&c->completion_wait);
-    if (!wait_while_busy(d))
-        PANIC("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-    input_sector(c, buffer);
-    lock_release(&c->lock);
+    ide_read_vector(d_, sec_no, 1, &buffer, 1);
 }
 
 /*! Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -336,32 +453,28 @@ static void ide_read(void *d_, block_sector_t sec_no, void *buffer) {
     receiving the data.  Internally synchronizes accesses to disks, so external
     per-disk locking is unneeded. */
 static void ide_write(void *d_, block_sector_t sec_no, const void *buffer) {
-    struct ata_disk *d = d_;
-    struct channel *c = d->channel;
-    lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-    if (!wait_while_busy(d))
-        PANIC("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-    output_sector(c, buffer);
-    sema_down(&c->completion_wait);
-    lock_release(&c->lock);
+    ide_write_vector(d_, sec_no, 1, &buffer, 1);
 }
 
 static struct block_operations ide_operations = {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_vector,
+    ide_write_vector
 };
 
 /*! Selects device D, waiting for it to become ready, and then writes SEC_NO
-    to the disk's sector selection registers.  (We use LBA mode.) */
-static void select_sector(struct ata_disk *d, block_sector_t sec_no) {
+    and the sector count CNT to the disk's sector selection registers.  (We
+    use LBA mode.) */
+static void select_sectors(struct ata_disk *d, block_sector_t sec_no,
+                           size_t cnt) {
     struct channel *c = d->channel;
 
     ASSERT(sec_no < (1UL << 28));
+    ASSERT(cnt > 0 && cnt <= MAX_COMMAND_SECTORS);
   
     select_device_wait(d);
-    outb(reg_nsect(c), 1);
+    outb(reg_nsect(c), cnt);
     outb(reg_lbal(c), sec_no);
     outb(reg_lbam(c), sec_no >> 8);
     outb(reg_lbah(c), (sec_no >> 16));
@@ -473,3 +586,51 @@ static void interrupt_handler(struct intr_frame *f) {
 }
 
 
+
+/*! Acquires channel C's lock, accounting for the time spent waiting. */
+static void channel_acquire(struct channel *c) {
+    uint64_t start = rdtsc();
+    bool contended = !lock_try_acquire(&c->lock);
+    if (contended)
+        lock_acquire(&c->lock);
+    c->acquired_at = rdtsc();
+    c->acquires++;
+    if (contended)
+        c->contended++;
+    c->wait_cycles += c->acquired_at - start;
+}
+
+/*! Releases channel C's lock, accounting for the time it was held. */
+static void channel_release(struct channel *c) {
+    c->hold_cycles += rdtsc() - c->acquired_at;
+    lock_release(&c->lock);
+}
+
+/*! Formats statistics about the use of each channel which has been used
+    into the SIZE bytes of BUF, one line each. Returns the number of bytes
+    written, not counting the null terminator. */
+size_t ide_stats_format(char *buf, size_t size) {
+    size_t len = 0;
+
+    if (size == 0)
+        return 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < CHANNEL_CNT && len + 1 < size; i++) {
+        struct channel *c = &channels[i];
+        if (c->acquires == 0)
+            continue;
+        len += snprintf(buf + len, size - len, "%s: %llu acquires, %llu "
+                        "contended, %"PRIu64" cycles waiting, %"PRIu64
+                        " cycles held\n", c->name, c->acquires, c->contended,
+                        c->wait_cycles, c->hold_cycles);
+    }
+    return len < size ? len : size - 1;
+}
+
+/*! Prints statistics about the use of each channel. */
+void ide_print_stats(void) {
+    char buf[256];
+
+    ide_stats_format(buf, sizeof buf);
+    printf("%s", buf);
+}
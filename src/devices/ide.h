@@ -1,7 +1,10 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stddef.h>
+
 void ide_init(void);
+size_t ide_stats_format(char *buf, size_t size);
+void ide_print_stats(void);
 
 #endif /* devices/ide.h */
-
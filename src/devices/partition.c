@@ -296,8 +296,30 @@ static void partition_write(void *p_, block_sector_t sector,
     block_write(p->block, p->start + sector, buffer);
 }
 
+/*! Reads CNT sectors starting at SECTOR from partition P into BUFFERS, each
+    of which has room for BUF_SECTORS sectors. */
+static void partition_read_vector(void *p_, block_sector_t sector,
+                                  size_t cnt, void *const *buffers,
+                                  size_t buf_sectors) {
+    struct partition *p = p_;
+    block_read_vector(p->block, p->start + sector, cnt / buf_sectors,
+                      buf_sectors, buffers);
+}
+
+/*! Writes CNT sectors starting at SECTOR to partition P from BUFFERS, each
+    of which contains BUF_SECTORS sectors. */
+static void partition_write_vector(void *p_, block_sector_t sector,
+                                   size_t cnt, const void *const *buffers,
+                                   size_t buf_sectors) {
+    struct partition *p = p_;
+    block_write_vector(p->block, p->start + sector, cnt / buf_sectors,
+                       buf_sectors, buffers);
+}
+
 static struct block_operations partition_operations = {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_vector,
+    partition_write_vector
 };
 
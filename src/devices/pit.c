@@ -15,9 +15,6 @@
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /*!< Counter port. */
 /*! @} */
 
-/*! PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /*! Configure the given CHANNEL in the PIT.  In a PC, the PIT's
     three output channels are hooked up like this:
 
@@ -41,7 +38,8 @@
        the second half it is 0.  This is useful for generating a tone on a
        speaker.
 
-     - Other modes are less useful.
+     - Mode 0, a single countdown, is set up by pit_start_oneshot() instead.
+       Other modes are less useful.
 
     FREQUENCY is the number of periods per second, in Hz. */
 void pit_configure_channel(int channel, int mode, int frequency) {
@@ -79,3 +77,33 @@ void pit_configure_channel(int channel, int mode, int frequency) {
     intr_set_level(old_level);
 }
 
+
+/*! Starts channel 0 counting down COUNT cycles in mode 0, "interrupt on
+    terminal count": the channel's output drops to 0 now and rises to 1, which
+    raises interrupt line 0, once the count reaches zero.  It then stays at 1
+    until the channel is programmed again, while the counter keeps counting
+    down from 65535.  A COUNT of 0 counts 65536 cycles. */
+void pit_start_oneshot(uint16_t count) {
+    enum intr_level old_level = intr_disable();
+    outb(PIT_PORT_CONTROL, 0x30);
+    outb(PIT_PORT_COUNTER(0), count);
+    outb(PIT_PORT_COUNTER(0), count >> 8);
+    intr_set_level(old_level);
+}
+
+/*! Reads the current count of channel 0 into *COUNT and returns its output,
+    which in mode 0 tells whether the count has reached zero.  Uses the
+    read-back command, which latches the status and the count together. */
+bool pit_read_oneshot(uint16_t *count) {
+    enum intr_level old_level = intr_disable();
+    uint8_t status, lo, hi;
+
+    outb(PIT_PORT_CONTROL, 0xc2);
+    status = inb(PIT_PORT_COUNTER(0));
+    lo = inb(PIT_PORT_COUNTER(0));
+    hi = inb(PIT_PORT_COUNTER(0));
+    intr_set_level(old_level);
+
+    *count = lo | (hi << 8);
+    return (status & 0x80) != 0;
+}
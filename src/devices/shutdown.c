@@ -5,14 +5,24 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/swapcache.h"
+#endif
 
 /*! Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -109,13 +119,25 @@ void shutdown_power_off(void) {
 static void print_stats(void) {
     timer_print_stats();
     thread_print_stats();
+    palloc_print_stats();
+    kmem_print_stats();
 #ifdef FILESYS
     block_print_stats();
+    ide_print_stats();
 #endif
     console_print_stats();
     kbd_print_stats();
 #ifdef USERPROG
     exception_print_stats();
+    syscall_print_stats();
+#endif
+#ifdef VM
+    swapcache_print_stats();
+#endif
+#ifdef LOCK_PROFILE
+    lock_print_stats();
 #endif
+    profile_print_stats();
+    trace_print_stats();
 }
 
@@ -1,6 +1,25 @@
 /*! \file timer.c
  *
  * See [8254] for hardware details of the 8254 timer chip.
+ *
+ * Kernel timers are kept in a hierarchical timing wheel, so setting and
+ * cancelling one takes constant time no matter how many are pending. The
+ * root of the wheel has a slot for each of the next ROOT_SLOTS ticks. Each
+ * further level has LEVEL_SLOTS slots, each covering as many ticks as all of
+ * the level below. Whenever the root wraps around, the timers in the next
+ * slot of the level above are moved down, and so on upward, so each timer is
+ * moved at most once per level before it expires.
+ *
+ * By default the 8254 interrupts TIMER_FREQ times per second.  With the
+ * -tickless option it is instead programmed for one countdown at a time, in
+ * mode 0, ending at the next event: the next tick while a thread is running,
+ * so that time slices and statistics work as before, but while the idle
+ * thread waits, the first tick with a timer due, skipping the ticks between.
+ * Each interrupt then runs thread_tick() once for each tick that has passed.
+ * Time is kept as a count of PIT cycles, read back from the PIT whenever the
+ * countdown is changed, so sleeps are as precise as the PIT: a sleep ends
+ * with an interrupt at its deadline rather than at the next tick, and
+ * sub-tick sleeps need not busy-wait.
  */
 
 #include "devices/timer.h"
@@ -10,9 +29,69 @@
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
-  
+#include "threads/vaddr.h"
+
+/*! Timer wheel geometry. @{ */
+#define ROOT_BITS 8
+#define ROOT_SLOTS (1 << ROOT_BITS)
+#define LEVEL_BITS 6
+#define LEVEL_SLOTS (1 << LEVEL_BITS)
+#define LEVELS 3                /*!< Levels above the root. */
+/*! @} */
+
+/*! Timers expiring within the next ROOT_SLOTS ticks, by deadline. */
+static list_t wheel_root[ROOT_SLOTS];
+/*! Timers expiring later, by deadline. Timers beyond the last level's range
+    wait in its farthest slot and are placed again when it is moved down. */
+static list_t wheel[LEVELS][LEVEL_SLOTS];
+/*! Next tick whose timers have not yet run. */
+static int64_t wheel_time;
+
+/*! Expired deferred timers for the timer thread, and a semaphore upped when
+    each is added. Cancelled timers are removed without downing it. */
+static list_t deferred_timers;
+static semaphore_t deferred_sema;
+
+/*! Whether the PIT is programmed one countdown at a time rather than to
+    interrupt periodically. Set by the -tickless command-line option. */
+bool timer_tickless;
+
+/*! Bounds on a one-shot countdown, in PIT cycles. The lower one limits the
+    interrupt rate when events are close together. @{ */
+#define MIN_COUNT 32
+#define MAX_COUNT 0xffff
+/*! @} */
+
+/*! Most ticks that fit in one countdown. */
+#define MAX_SKIP (MAX_COUNT * TIMER_FREQ / PIT_HZ + 1)
+
+/*! In tickless mode, the PIT cycle at which the current countdown started,
+    and its length in cycles. */
+static uint64_t count_start;
+static uint16_t count_len;
+/*! In tickless mode, whether the idle thread is waiting for an interrupt, so
+    that ticks with nothing to do may be skipped. */
+static bool idle_skip;
+
+/*! A thread sleeping until a deadline in PIT cycles. */
+typedef struct precise_sleeper {
+    list_elem_t elem;       /*!< Element in `precise_sleepers'. */
+    uint64_t deadline;      /*!< PIT cycle at which to wake. */
+    ktimer_t timer;         /*!< Puts it on `precise_sleepers' at the tick in
+                                 which its deadline falls. */
+    struct thread *thread;  /*!< The sleeping thread. */
+} precise_sleeper_t;
+
+/*! Sleepers whose deadlines fall within the current tick or are near it,
+    ordered by deadline. */
+static list_t precise_sleepers;
+
+/*! Number of timer interrupts, for statistics. */
+static int64_t interrupt_cnt;
+
 #if TIMER_FREQ < 19
 #error 8254 timer requires TIMER_FREQ >= 19
 #endif
@@ -28,14 +107,40 @@ static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 static void real_time_delay(int64_t num, int32_t denom);
+static void wheel_run(void);
+static thread_func timer_thread;
+static void clock_program(uint64_t now);
+static void precise_sleep(int64_t num, int32_t denom);
 
 /*! Sets up the timer to interrupt TIMER_FREQ times per second,
     and registers the corresponding interrupt. */
 void timer_init(void) {
-    pit_configure_channel(0, 2, TIMER_FREQ);
+    for (size_t i = 0; i < ROOT_SLOTS; i++) {
+        list_init(&wheel_root[i]);
+    }
+    for (size_t level = 0; level < LEVELS; level++) {
+        for (size_t i = 0; i < LEVEL_SLOTS; i++) {
+            list_init(&wheel[level][i]);
+        }
+    }
+    list_init(&deferred_timers);
+    sema_init(&deferred_sema, 0);
+    list_init(&precise_sleepers);
+    wheel_time = ticks;
+
+    if (timer_tickless)
+        clock_program(0);
+    else
+        pit_configure_channel(0, 2, TIMER_FREQ);
     intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
 
+/*! Starts the thread that runs deferred timers. Must be called after the
+    thread system has been started. */
+void timer_start(void) {
+    thread_create("timer", PRI_DEFAULT, timer_thread, NULL);
+}
+
 /*! Calibrates loops_per_tick, used to implement brief delays. */
 void timer_calibrate(void) {
     unsigned high_bit, test_bit;
@@ -128,12 +233,325 @@ void timer_ndelay(int64_t ns) {
 
 /*! Prints timer statistics. */
 void timer_print_stats(void) {
-    printf("Timer: %"PRId64" ticks\n", timer_ticks());
+    printf("Timer: %"PRId64" ticks, %"PRId64" interrupts\n",
+           timer_ticks(), interrupt_cnt);
+}
+
+/*! Initializes TIMER to call FUNC with AUX from the timer interrupt when it
+    expires. The timer is not set. */
+void ktimer_init(ktimer_t *timer, ktimer_func *func, void *aux) {
+    ASSERT(timer != NULL);
+    ASSERT(func != NULL);
+
+    timer->deadline = 0;
+    timer->func = func;
+    timer->aux = aux;
+    timer->deferred = false;
+    timer->pending = false;
+}
+
+/*! Initializes TIMER to call FUNC with AUX from the timer thread when it
+    expires, so that FUNC may sleep. The timer is not set. */
+void ktimer_init_deferred(ktimer_t *timer, ktimer_func *func, void *aux) {
+    ktimer_init(timer, func, aux);
+    timer->deferred = true;
+}
+
+/*! Adds TIMER to the slot of the wheel for its deadline. Interrupts must be
+    off. */
+static void wheel_add(ktimer_t *timer) {
+    int64_t delta = timer->deadline - wheel_time;
+    list_t *slot;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (delta < ROOT_SLOTS) {
+        /* Timers already due run at the next tick. */
+        int64_t when = delta < 0 ? wheel_time : timer->deadline;
+        slot = &wheel_root[when & (ROOT_SLOTS - 1)];
+    }
+    else {
+        int64_t when = timer->deadline;
+        size_t level = 0;
+        int shift = ROOT_BITS;
+        while (level < LEVELS - 1 && delta >> (shift + LEVEL_BITS) != 0) {
+            level++;
+            shift += LEVEL_BITS;
+        }
+        if (delta >> (shift + LEVEL_BITS) != 0) {
+            when = wheel_time + ((int64_t) 1 << (shift + LEVEL_BITS)) - 1;
+        }
+        slot = &wheel[level][(when >> shift) & (LEVEL_SLOTS - 1)];
+    }
+    list_push_back(slot, &timer->elem);
+}
+
+/*! Sets TIMER to expire once the timer tick count reaches DEADLINE, or at the
+    next tick if it already has. If TIMER is already set, its deadline is
+    changed. May be called from an interrupt handler, including a timer's
+    function. */
+void ktimer_set(ktimer_t *timer, int64_t deadline) {
+    enum intr_level old_level = intr_disable();
+    if (timer->pending) {
+        list_remove(&timer->elem);
+    }
+    timer->deadline = deadline;
+    timer->pending = true;
+    wheel_add(timer);
+    intr_set_level(old_level);
+}
+
+/*! Cancels TIMER. Returns true if it was set and its function will now not be
+    called, or false if it was not set or its function has already been
+    called or is being called. */
+bool ktimer_cancel(ktimer_t *timer) {
+    enum intr_level old_level = intr_disable();
+    bool was_pending = timer->pending;
+    if (was_pending) {
+        list_remove(&timer->elem);
+        timer->pending = false;
+    }
+    intr_set_level(old_level);
+    return was_pending;
+}
+
+/*! Expires TIMER, which has been removed from the wheel. */
+static void timer_expire(ktimer_t *timer) {
+    if (timer->deferred) {
+        list_push_back(&deferred_timers, &timer->elem);
+        sema_up(&deferred_sema);
+    }
+    else {
+        timer->pending = false;
+        timer->func(timer, timer->aux);
+    }
+}
+
+/*! Moves the timers in the current slot of each level of the wheel down,
+    from the bottom level upward as long as each level is also wrapping
+    around. Called when the root wraps around. */
+static void wheel_cascade(void) {
+    for (size_t level = 0; level < LEVELS; level++) {
+        int shift = ROOT_BITS + level * LEVEL_BITS;
+        size_t idx = (wheel_time >> shift) & (LEVEL_SLOTS - 1);
+        list_t moved;
+
+        list_init(&moved);
+        while (!list_empty(&wheel[level][idx])) {
+            list_push_back(&moved, list_pop_front(&wheel[level][idx]));
+        }
+        while (!list_empty(&moved)) {
+            wheel_add(list_entry(list_pop_front(&moved), ktimer_t, elem));
+        }
+        if (idx != 0) break;
+    }
+}
+
+/*! Runs the timers which have expired by the current tick. Timers set by
+    their functions to expire again right away run at the next tick. */
+static void wheel_run(void) {
+    while (wheel_time <= ticks) {
+        size_t idx = wheel_time & (ROOT_SLOTS - 1);
+        list_t *slot = &wheel_root[idx];
+
+        if (idx == 0) wheel_cascade();
+        wheel_time++;
+        while (!list_empty(slot)) {
+            timer_expire(list_entry(list_pop_front(slot), ktimer_t, elem));
+        }
+    }
+}
+
+/*! Runs the functions of expired deferred timers. */
+static void timer_thread(void *aux UNUSED) {
+    while (true) {
+        sema_down(&deferred_sema);
+
+        enum intr_level old_level = intr_disable();
+        ktimer_t *timer = NULL;
+        if (!list_empty(&deferred_timers)) {
+            timer = list_entry(list_pop_front(&deferred_timers),
+                               ktimer_t, elem);
+            timer->pending = false;
+        }
+        intr_set_level(old_level);
+
+        if (timer != NULL) timer->func(timer, timer->aux);
+    }
+}
+
+/*! Returns the first tick, after those already run, at which the wheel may
+    have work: the first with a timer in the root, or the next time the root
+    wraps around and timers move down, looking no further than a countdown
+    can reach. */
+static int64_t wheel_next_event(void) {
+    int64_t t;
+    for (t = wheel_time; t < ticks + MAX_SKIP; t++) {
+        size_t idx = t & (ROOT_SLOTS - 1);
+        if (idx == 0 || !list_empty(&wheel_root[idx])) break;
+    }
+    return t;
+}
+
+/*! Returns the PIT cycle at which tick T starts. */
+static uint64_t tick_start(int64_t t) {
+    return (uint64_t) t * PIT_HZ / TIMER_FREQ;
+}
+
+/*! Returns the current time in PIT cycles, in tickless mode. Interrupts
+    must be off. If FIRED is non-null, stores in it whether the current
+    countdown has ended. */
+static uint64_t clock_now(bool *fired_) {
+    static uint64_t last;
+    uint16_t count;
+    bool fired = pit_read_oneshot(&count);
+    uint64_t now;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    /* Once the countdown ends, the counter goes on from 65535. */
+    if (fired)
+        now = count_start + count_len + (uint16_t) -count;
+    else if (count <= count_len)
+        now = count_start + (count_len - count);
+    else
+        now = count_start;      /* Not loaded yet. */
+
+    /* Time never runs backward, even if the countdown wrapped around. */
+    if (now < last)
+        now = last;
+    last = now;
+    if (fired_ != NULL)
+        *fired_ = fired;
+    return now;
+}
+
+/*! Starts a countdown from NOW to the next event, in tickless mode.
+    Interrupts must be off. */
+static void clock_program(uint64_t now) {
+    uint64_t next;
+    uint64_t count;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    next = tick_start(idle_skip ? wheel_next_event() : ticks + 1);
+    if (!list_empty(&precise_sleepers)) {
+        precise_sleeper_t *s = list_entry(list_front(&precise_sleepers),
+                                          precise_sleeper_t, elem);
+        if (s->deadline < next) next = s->deadline;
+    }
+
+    count = next > now ? next - now : 0;
+    if (count < MIN_COUNT) count = MIN_COUNT;
+    if (count > MAX_COUNT) count = MAX_COUNT;
+    count_start = now;
+    count_len = count;
+    pit_start_oneshot(count);
+}
+
+/*! Starts a new countdown to the next event, which may have changed, in
+    tickless mode. Interrupts must be off. If the current countdown has
+    already ended, the interrupt it raised does this instead. A countdown
+    that ends while this runs raises an interrupt early, which is harmless. */
+static void clock_reprogram(void) {
+    bool fired;
+    uint64_t now = clock_now(&fired);
+
+    if (!fired) clock_program(now);
+}
+
+/*! Called by the idle thread, with interrupts off, just before it waits for
+    an interrupt. In tickless mode, lets the timer skip ticks until one with
+    a timer due. */
+void timer_idle_enter(void) {
+    ASSERT(intr_get_level() == INTR_OFF);
+    if (timer_tickless) {
+        idle_skip = true;
+        clock_reprogram();
+    }
+}
+
+/*! Called by the scheduler, with interrupts off, when it switches away from
+    the idle thread. In tickless mode, has the timer interrupt at each tick
+    again. */
+void timer_idle_exit(void) {
+    ASSERT(intr_get_level() == INTR_OFF);
+    if (timer_tickless && idle_skip) {
+        idle_skip = false;
+        clock_reprogram();
+    }
+}
+
+/*! Wakes the precise sleepers whose deadlines have passed by NOW. */
+static void precise_wake(uint64_t now) {
+    while (!list_empty(&precise_sleepers)) {
+        precise_sleeper_t *s = list_entry(list_front(&precise_sleepers),
+                                          precise_sleeper_t, elem);
+        if (s->deadline > now) break;
+        list_pop_front(&precise_sleepers);
+        thread_unblock(s->thread);
+    }
+}
+
+/*! Orders precise sleepers by deadline. */
+static bool precise_less(const list_elem_t *a, const list_elem_t *b,
+                         void *aux UNUSED) {
+    return list_entry(a, precise_sleeper_t, elem)->deadline <
+           list_entry(b, precise_sleeper_t, elem)->deadline;
+}
+
+/*! Puts precise sleeper S on the list of those due soon. Called by its
+    timer at the tick in which its deadline falls. */
+static void precise_arm(ktimer_t *timer UNUSED, void *s_) {
+    precise_sleeper_t *s = s_;
+    list_insert_ordered(&precise_sleepers, &s->elem, precise_less, NULL);
+}
+
+/*! Sleeps for NUM/DENOM seconds, to the precision of the PIT, in tickless
+    mode. Until the tick in which the deadline falls, the sleeper waits on the
+    wheel like any other, so only sleepers due soon are kept in order. */
+static void precise_sleep(int64_t num, int32_t denom) {
+    precise_sleeper_t s;
+    uint64_t cycles = num / denom * PIT_HZ + num % denom * PIT_HZ / denom;
+    int64_t tick;
+
+    ASSERT(!intr_context());
+
+    enum intr_level old_level = intr_disable();
+    s.deadline = clock_now(NULL) + cycles;
+    s.thread = thread_current();
+    tick = s.deadline * TIMER_FREQ / PIT_HZ;
+    if (tick > ticks) {
+        ktimer_init(&s.timer, precise_arm, &s);
+        ktimer_set(&s.timer, tick);
+    }
+    else {
+        precise_arm(NULL, &s);
+        clock_reprogram();
+    }
+    thread_block();
+    intr_set_level(old_level);
 }
 
 /*! Timer interrupt handler. */
-static void timer_interrupt(intr_frame_t *args UNUSED) {
-    thread_tick();
+static void timer_interrupt(intr_frame_t *args) {
+    interrupt_cnt++;
+    if (timer_tickless) {
+        uint64_t now = clock_now(NULL);
+        while (tick_start(ticks + 1) <= now) {
+            profile_sample(args);
+            thread_tick(is_user_vaddr((void *) args->eip));
+        }
+        wheel_run();
+        precise_wake(now);
+        clock_program(now);
+    }
+    else {
+        profile_sample(args);
+        thread_tick(is_user_vaddr((void *) args->eip));
+        wheel_run();
+    }
+    thread_yield_if_lost_primacy();
 }
 
 /*! Returns true if LOOPS iterations waits for more than one timer tick,
@@ -174,7 +592,11 @@ static void real_time_sleep(int64_t num, int32_t denom) {
     int64_t ticks = num * TIMER_FREQ / denom;
 
     ASSERT(intr_get_level() == INTR_ON);
-    if (ticks > 0) {
+    if (timer_tickless && num > 0) {
+        /* Without periodic ticks the timer can wake us when we ask. */
+        precise_sleep(num, denom);
+    }
+    else if (ticks > 0) {
         /* We're waiting for at least one full timer tick.  Use timer_sleep()
            because it will yield the CPU to other processes. */                
         timer_sleep(ticks); 
@@ -1,15 +1,52 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /*! Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+struct ktimer;
+
+/*! Function called when kernel timer TIMER expires, given auxiliary data
+    AUX. */
+typedef void ktimer_func(struct ktimer *timer, void *aux);
+
+/*! A kernel timer, which calls a function once the timer tick count reaches
+    its deadline. The function is called from the timer interrupt, so it must
+    not sleep, unless the timer is deferred, in which case it is called from
+    the timer thread and may. */
+typedef struct ktimer {
+    list_elem_t elem;       /*!< Element in a timer wheel slot, or in the
+                                 list of expired deferred timers. */
+    int64_t deadline;       /*!< Tick at which to call the function. */
+    ktimer_func *func;      /*!< Function to call. */
+    void *aux;              /*!< Auxiliary data for the function. */
+    bool deferred;          /*!< Whether the function is called from the
+                                 timer thread. */
+    bool pending;           /*!< Whether the timer is set and its function
+                                 has not been called since. */
+} ktimer_t;
+
+extern bool timer_tickless;
+
 void timer_init(void);
+void timer_start(void);
 void timer_calibrate(void);
 
+/* Tickless idle. */
+void timer_idle_enter(void);
+void timer_idle_exit(void);
+
+/* Kernel timers. */
+void ktimer_init(ktimer_t *, ktimer_func *, void *aux);
+void ktimer_init_deferred(ktimer_t *, ktimer_func *, void *aux);
+void ktimer_set(ktimer_t *, int64_t deadline);
+bool ktimer_cancel(ktimer_t *);
+
 int64_t timer_ticks(void);
 int64_t timer_elapsed(int64_t);
 
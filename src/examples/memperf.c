@@ -0,0 +1,175 @@
+/* memperf.c
+
+   Microbenchmark comparing the C library's memcpy, memmove,
+   memset, memcmp and strlen against simple byte-at-a-time
+   loops, for a few block sizes.  Times are in CPU cycles, as
+   measured by the time stamp counter.  The total time and the
+   resources used are printed at the end. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Number of times each operation is repeated. */
+#define ITERATIONS 1000
+
+/* Largest block size, and the size of the buffers. */
+#define MAX_SIZE 4096
+
+static char src[MAX_SIZE + 64];
+static char dst[MAX_SIZE + 64];
+
+/* Returns the time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Byte-at-a-time versions, as lib/string.c used to have.  The
+   volatile pointers keep the compiler from turning the loops
+   into calls to the functions being measured. */
+
+static void
+byte_memcpy (void *dst_, const void *src_, size_t size)
+{
+  volatile unsigned char *dst = dst_;
+  const volatile unsigned char *src = src_;
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+static void
+byte_memmove (void *dst_, const void *src_, size_t size)
+{
+  volatile unsigned char *dst = dst_;
+  const volatile unsigned char *src = src_;
+  dst += size;
+  src += size;
+  while (size-- > 0)
+    *--dst = *--src;
+}
+
+static void
+byte_memset (void *dst_, int value, size_t size)
+{
+  volatile unsigned char *dst = dst_;
+  while (size-- > 0)
+    *dst++ = value;
+}
+
+static int
+byte_memcmp (const void *a_, const void *b_, size_t size)
+{
+  const volatile unsigned char *a = a_;
+  const volatile unsigned char *b = b_;
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
+
+static size_t
+byte_strlen (const char *string)
+{
+  const volatile char *p;
+  for (p = string; *p != '\0'; p++)
+    continue;
+  return p - string;
+}
+
+/* The operations to measure. */
+enum op
+  {
+    OP_MEMCPY,
+    OP_MEMMOVE,
+    OP_MEMSET,
+    OP_MEMCMP,
+    OP_STRLEN,
+    OP_CNT
+  };
+
+static const char *op_names[OP_CNT] =
+  { "memcpy", "memmove", "memset", "memcmp", "strlen" };
+
+/* Runs OP on SIZE bytes ITERATIONS times, using the byte-at-a-time
+   version if BYTEWISE, and returns the average number of cycles
+   per run.  The destination is offset by a byte from the source
+   so that unaligned copies are measured too. */
+static unsigned
+measure (enum op op, size_t size, bool bytewise)
+{
+  volatile size_t sink = 0;
+  uint64_t start;
+  int i;
+
+  /* The overlapping move copies downward, the harder direction. */
+  memset (src, 'x', size);
+  src[size] = '\0';
+  memcpy (dst + 1, src, size);
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    switch (op)
+      {
+      case OP_MEMCPY:
+        if (bytewise)
+          byte_memcpy (dst + 1, src, size);
+        else
+          memcpy (dst + 1, src, size);
+        break;
+      case OP_MEMMOVE:
+        if (bytewise)
+          byte_memmove (src + 1, src, size);
+        else
+          memmove (src + 1, src, size);
+        break;
+      case OP_MEMSET:
+        if (bytewise)
+          byte_memset (dst, 'y', size);
+        else
+          memset (dst, 'y', size);
+        break;
+      case OP_MEMCMP:
+        sink += bytewise ? byte_memcmp (dst + 1, src, size)
+                         : memcmp (dst + 1, src, size);
+        break;
+      case OP_STRLEN:
+        sink += bytewise ? byte_strlen (src) : strlen (src);
+        break;
+      default:
+        break;
+      }
+  return (rdtsc () - start) / ITERATIONS;
+}
+
+int
+main (void)
+{
+  static const size_t sizes[] = { 16, 512, 4096 };
+  struct rusage usage;
+  int start = gettime ();
+  size_t i;
+  int op;
+
+  printf ("%-8s %6s %12s %12s %8s\n",
+          "op", "bytes", "byte loop", "lib/string", "speedup");
+  for (op = 0; op < OP_CNT; op++)
+    for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+      {
+        unsigned slow = measure (op, sizes[i], true);
+        unsigned fast = measure (op, sizes[i], false);
+        printf ("%-8s %6zu %12u %12u %7u.%ux\n", op_names[op], sizes[i],
+                slow, fast, slow / (fast ? fast : 1),
+                slow * 10 / (fast ? fast : 1) % 10);
+      }
+
+  if (getrusage (&usage))
+    printf ("%d ms elapsed, %llu user and %llu kernel ticks, "
+            "%llu page faults, %llu involuntary switches\n",
+            gettime () - start, usage.user_ticks, usage.kernel_ticks,
+            usage.page_faults, usage.involuntary_switches);
+  return EXIT_SUCCESS;
+}
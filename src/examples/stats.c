@@ -0,0 +1,70 @@
+/* stats.c
+
+   Prints kernel statistics read with the stats system call.
+
+   Usage: stats KIND...
+   where each KIND is one of:
+     locks      lock contention (kernel built with LOCK_PROFILE)
+     syscalls   system calls made by this process
+     trace      latest kernel events (kernel run with -trace)
+     block      block device requests
+     ide        IDE channel lock use
+     tunables   tunables and their values */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+
+/* Kinds of statistics, by name. */
+static const struct
+  {
+    const char *name;
+    int kind;
+  }
+kinds[] =
+  {
+    { "locks", STATS_LOCKS },
+    { "syscalls", STATS_SYSCALLS },
+    { "trace", STATS_TRACE },
+    { "block", STATS_BLOCK },
+    { "ide", STATS_IDE },
+    { "tunables", STATS_TUNABLES },
+  };
+
+static char buffer[4096];
+
+int
+main (int argc, char *argv[])
+{
+  bool success = true;
+  int i;
+
+  if (argc < 2)
+    {
+      printf ("usage: stats KIND...\n");
+      return EXIT_FAILURE;
+    }
+
+  for (i = 1; i < argc; i++)
+    {
+      size_t k;
+
+      for (k = 0; k < sizeof kinds / sizeof *kinds; k++)
+        if (!strcmp (argv[i], kinds[k].name))
+          break;
+      if (k == sizeof kinds / sizeof *kinds)
+        {
+          printf ("%s: unknown kind of statistics\n", argv[i]);
+          success = false;
+        }
+      else if (stats (kinds[k].kind, buffer, sizeof buffer) < 0)
+        {
+          printf ("%s: not available\n", argv[i]);
+          success = false;
+        }
+      else
+        printf ("%s", buffer);
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,37 @@
+/* tune.c
+
+   Sets kernel tunables, or lists them.
+
+   Usage: tune [NAME=VALUE...]
+   With no arguments, prints each tunable, its value and its
+   range.  Tunables marked "at boot" can only be set on the kernel
+   command line, with -tune=NAME=VALUE. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+
+static char buffer[4096];
+
+int
+main (int argc, char *argv[])
+{
+  bool success = true;
+  int i;
+
+  if (argc < 2)
+    {
+      if (stats (STATS_TUNABLES, buffer, sizeof buffer) < 0)
+        return EXIT_FAILURE;
+      printf ("%s", buffer);
+      return EXIT_SUCCESS;
+    }
+
+  for (i = 1; i < argc; i++)
+    if (!tune (argv[i]))
+      {
+        printf ("%s: cannot set\n", argv[i]);
+        success = false;
+      }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
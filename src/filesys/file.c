@@ -1,29 +1,68 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <string.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
 #include <stdio.h>
 
-/*! An open file. */
+/*! An open file. A file is either backed by an inode, or is a read-only
+    text file whose contents are in a page of memory, as opened by
+    file_open_text(). */
 typedef struct file {
-    inode_t *inode;             /*!< File's inode. */
+    inode_t *inode;             /*!< File's inode, or NULL for text. */
+    char *text;                 /*!< Page of contents, if not an inode. */
+    off_t text_len;             /*!< Bytes of TEXT which are contents. */
     off_t pos;                  /*!< Current position. */
     bool deny_write;            /*!< Has file_deny_write() been called? */
 } file_t;
 
+/*! Cache from which files are allocated. */
+static kmem_cache_t *file_cache;
+
+/*! Initializes the file module. */
+void file_init(void) {
+    file_cache = kmem_cache_create("file", sizeof(file_t), NULL);
+}
+
 /*! Opens a file for the given INODE, of which it takes ownership,
     and returns the new file. Returns a null pointer if an
     allocation fails or if INODE is null. */
 file_t *file_open(inode_t *inode) {
     if (inode == NULL) return NULL;
 
-    file_t *file = calloc(1, sizeof(file_t));
+    file_t *file = kmem_cache_alloc(file_cache);
     if (file == NULL) {
         inode_close(inode);
         return NULL;
     }
 
     file->inode = inode;
+    file->text = NULL;
+    file->text_len = 0;
+    file->pos = 0;
+    file->deny_write = false;
+    return file;
+}
+
+/*! Opens a read-only file whose contents are the first LENGTH bytes of
+    PAGE, which was obtained from palloc_get_page() and of which the file
+    takes ownership. Returns the new file, or a null pointer if an allocation
+    fails or if PAGE is null. */
+file_t *file_open_text(char *page, off_t length) {
+    ASSERT(length >= 0 && length <= PGSIZE);
+    if (page == NULL) return NULL;
+
+    file_t *file = kmem_cache_alloc(file_cache);
+    if (file == NULL) {
+        palloc_free_page(page);
+        return NULL;
+    }
+
+    file->inode = NULL;
+    file->text = page;
+    file->text_len = length;
     file->pos = 0;
     file->deny_write = false;
     return file;
@@ -32,6 +71,12 @@ file_t *file_open(inode_t *inode) {
 /*! Opens and returns a new file for the same inode as FILE.
     Returns a null pointer if unsuccessful. */
 file_t *file_reopen(file_t *file) {
+    if (file->text != NULL) {
+        char *page = palloc_get_page(0);
+        if (page == NULL) return NULL;
+        memcpy(page, file->text, file->text_len);
+        return file_open_text(page, file->text_len);
+    }
     return file_open(inode_reopen(file->inode));
 }
 
@@ -39,12 +84,27 @@ file_t *file_reopen(file_t *file) {
 void file_close(file_t *file) {
     if (file != NULL) {
         file_allow_write(file);
-        inode_close(file->inode);
-        free(file); 
+        if (file->text != NULL) {
+            palloc_free_page(file->text);
+        } else {
+            inode_close(file->inode);
+        }
+        kmem_cache_free(file_cache, file);
     }
 }
 
-/*! Returns the inode encapsulated by FILE. */
+/*! Reads SIZE bytes of text file FILE into BUFFER, starting at offset
+    FILE_OFS. Returns the number of bytes actually read. */
+static off_t text_read_at(file_t *file, void *buffer, off_t size,
+                          off_t file_ofs) {
+    if (file_ofs >= file->text_len) return 0;
+    if (size > file->text_len - file_ofs) size = file->text_len - file_ofs;
+    memcpy(buffer, file->text + file_ofs, size);
+    return size;
+}
+
+/*! Returns the inode encapsulated by FILE, or a null pointer if FILE was
+    opened with file_open_text(). */
 inode_t *file_get_inode(file_t *file) {
     return file->inode;
 }
@@ -54,7 +114,9 @@ inode_t *file_get_inode(file_t *file) {
     than SIZE if end of file is reached.  Advances FILE's position by the
     number of bytes read. */
 off_t file_read(file_t *file, void *buffer, off_t size) {
-    off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+    off_t bytes_read = file->text != NULL
+                       ? text_read_at(file, buffer, size, file->pos)
+                       : inode_read_at(file->inode, buffer, size, file->pos);
     file->pos += bytes_read;
     return bytes_read;
 }
@@ -65,6 +127,7 @@ off_t file_read(file_t *file, void *buffer, off_t size) {
     unaffected. */
 off_t file_read_at(file_t *file, void *buffer, off_t size,
                    off_t file_ofs) {
+    if (file->text != NULL) return text_read_at(file, buffer, size, file_ofs);
     return inode_read_at(file->inode, buffer, size, file_ofs);
 }
 
@@ -74,6 +137,7 @@ off_t file_read_at(file_t *file, void *buffer, off_t size,
     case, but file growth is not yet implemented.)
     Advances FILE's position by the number of bytes read. */
 off_t file_write(file_t *file, const void *buffer, off_t size) {
+    if (file->text != NULL) return 0;
     off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
     file->pos += bytes_written;
     return bytes_written;
@@ -86,6 +150,7 @@ off_t file_write(file_t *file, const void *buffer, off_t size) {
     The file's current position is unaffected. */
 off_t file_write_at(file_t *file, const void *buffer, off_t size,
                     off_t file_ofs) {
+    if (file->text != NULL) return 0;
     return inode_write_at(file->inode, buffer, size, file_ofs);
 }
 
@@ -95,7 +160,7 @@ void file_deny_write(file_t *file) {
     ASSERT(file != NULL);
     if (!file->deny_write) {
         file->deny_write = true;
-        inode_deny_write(file->inode);
+        if (file->inode != NULL) inode_deny_write(file->inode);
     }
 }
 
@@ -105,13 +170,14 @@ void file_allow_write(file_t *file) {
     ASSERT(file != NULL);
     if (file->deny_write) {
         file->deny_write = false;
-        inode_allow_write(file->inode);
+        if (file->inode != NULL) inode_allow_write(file->inode);
     }
 }
 
 /*! Returns the size of FILE in bytes. */
 off_t file_length(file_t *file) {
     ASSERT(file != NULL);
+    if (file->text != NULL) return file->text_len;
     return inode_length(file->inode);
 }
 
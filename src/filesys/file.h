@@ -9,7 +9,9 @@ struct inode;
 typedef struct file file_t;
 
 /* Opening and closing files. */
+void file_init (void);
 file_t *file_open (inode_t *);
+file_t *file_open_text (char *page, off_t length);
 file_t *file_reopen (file_t *);
 void file_close (file_t *);
 inode_t *file_get_inode (file_t *);
@@ -7,6 +7,7 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/fsdisk.h"
+#include "filesys/procfs.h"
 #include "threads/palloc.h"
 
 #define NO_SECTOR ((block_sector_t) -1)
@@ -21,9 +22,10 @@ static void do_format(void);
 void filesys_init(bool format) {
     fs_disk_init();
     inode_init();
-    free_map_init();
+    file_init();
 
     if (format) do_format();
+    free_map_init();
 }
 
 /*! Shuts down the file system module, writing any unwritten data to disk. */
@@ -176,6 +178,9 @@ static inode_t *filesys_open_inode(const char *path, dir_t *wd, bool *is_dir) {
     Fails if anything in PATH isn't a valid directory, or if an
     internal memory allocation fails. */
 file_t *filesys_open_file(const char *path, dir_t *wd) {
+    file_t *file;
+    if (procfs_open(path, &file)) return file;
+
     bool is_dir;
     inode_t *inode = filesys_open_inode(path, wd, &is_dir);
     if (is_dir) {
@@ -194,6 +199,12 @@ file_t *filesys_open_file(const char *path, dir_t *wd) {
 void *filesys_open(const char *path, dir_t *wd, bool *is_dir) {
     if (path == NULL || *path == '\0') return NULL;
 
+    file_t *file;
+    if (procfs_open(path, &file)) {
+        *is_dir = false;
+        return file;
+    }
+
     // If it ends in a slash, require that it's a directory
     if (path[strlen(path) - 1] == '/') {
         *is_dir = true;
@@ -6,9 +6,17 @@
 #include "filesys/fsdisk.h"
 #include "filesys/inode.h"
 
-/*! Initializes the free map. */
+/*! Initializes the free map, which must already have been read from disk
+    or created. The free map lives in the file system cache and is written to
+    disk as is, so its summary is kept in memory only and rebuilt on each
+    boot. */
 void free_map_init(void) {
-    // the current implementation requires no initialization.
+    bitmap_t *free_map = fs_cache_get_free_map_buf();
+    bool success = bitmap_enable_summary(free_map);
+    fs_cache_release(free_map);
+    if (!success) {
+        PANIC("free map summary allocation failed");
+    }
 }
 
 /*! Allocates CNT consecutive sectors from the free map and stores the first
@@ -1,11 +1,16 @@
-#include "hash.h"
+#include "ihash.h"
 #include "bitmap.h"
 #include "string.h"
 #include "debug.h"
+#include "stdio.h"
 #include "devices/timer.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "threads/trace.h"
 
 #include "filesys.h"
 #include "fsdisk.h"
@@ -21,7 +26,7 @@ typedef enum {
 
 /*! An entry in the cache. */
 typedef struct cache_entry {
-    hash_elem_t elem;                   /*!< Hash element to insert into cache. */
+    ihash_elem_t elem;                  /*!< Hash element to insert into cache. */
     block_sector_t sector;              /*!< The sector this caches. */
     uint32_t pin_count;                 /*!< The number of users pinning this. */
     lock_t evict;                       /*!< Lock to be held while evicting. */
@@ -61,20 +66,34 @@ static block_t *device;
 static bool cache_closed;
 
 /*! Hash map between sectors and the cache entries which represent them. */
-static hash_t cache;
+static ihash_t cache;
 
 /*! For working with the hashmap itself. */
 static lock_t cache_lock;
 
-/*! The size of the cache, in block device sectors. */
-#define CACHE_SECTORS 64
+/*! Cache statistics, protected by cache_lock. @{ */
+static unsigned long long cache_lookups;    /*!< Sectors looked up. */
+static unsigned long long cache_misses;     /*!< ...which were not cached. */
+static unsigned long long cache_evictions;  /*!< Sectors evicted. */
+/*! @} */
 
-/*! The memory actually used by the buffer. Allocated as a global variable 
-    since the size is known at compile time to avoid allocations. 
-    
-    NOTE: Pintos limits the total size of global variables to 1 megabyte, so the
-    cache should be significantly smaller than that. */
-static cache_entry_t entries[CACHE_SECTORS];
+/*! The size of the cache, in block device sectors. A tunable, fixed once
+    the cache is initialized. */
+size_t fs_cache_sectors = 64;
+
+/*! The memory actually used by the buffer, fs_cache_sectors entries.
+    Allocated a page at a time from the page allocator when the cache is
+    initialized, so that its size need not be known at compile time and is
+    not limited by the largest run of contiguous pages. */
+static cache_entry_t **entry_pages;
+
+/*! Number of cache entries in each page of entry_pages. */
+#define ENTRIES_PER_PAGE (PGSIZE / sizeof(cache_entry_t))
+
+/*! Returns the cache entry with index I. */
+static inline cache_entry_t *entry_at(size_t i) {
+    return &entry_pages[i / ENTRIES_PER_PAGE][i % ENTRIES_PER_PAGE];
+}
 
 /*! The cache buffer for the free map, which we're allowed to not count against
     our 64 cache sectors. It is also periodically flushed by the write_behind
@@ -102,14 +121,22 @@ static const uint8_t ZERO_BUF[BLOCK_SECTOR_SIZE] = { 0 };
     will simply be lost (since blocking on other read ahead requests would
     defeat the point, and losing read ahead requests is not a correctness
     error, only a potential performance penalty)*/
-#define READ_AHEAD_QUEUE_SIZE 16
+size_t fs_read_ahead_size = 16;        /*!< Size of the queue, a tunable which
+                                            is fixed once the queue starts.
+                                            At most FS_READ_AHEAD_MAX. */
 static semaphore_t read_ahead_free;    /*!< Semaphore of free spots. */
 static semaphore_t read_ahead_used;    /*!< Semaphore of used spots. */
 static lock_t read_ahead_lock;         /*!< Lock for the following fields. */
 static size_t read_ahead_head;         /*!< Next element to pop. */
 static size_t read_ahead_tail;         /*!< Where to insert next pushed element. */
 /*! The buffer for the queue. */
-static block_sector_t read_ahead_queue[READ_AHEAD_QUEUE_SIZE];
+static block_sector_t read_ahead_queue[FS_READ_AHEAD_MAX];
+
+/*! Number of ticks between write-behind flushes of the cache. A tunable. */
+size_t fs_flush_period = TIMER_FREQ / 10;
+
+/*! Timer which flushes the cache every fs_flush_period ticks. */
+static ktimer_t write_behind_timer;
 
 static void write_behind_start(void);
 
@@ -118,8 +145,8 @@ static void read_ahead_enqueue(block_sector_t);
 static block_sector_t read_ahead_dequeue(void);
 
 static void cache_clean(cache_entry_t *entry);
-static unsigned cache_hash(const hash_elem_t *, void *);
-static bool cache_less(const hash_elem_t *, const hash_elem_t *, void *);
+static unsigned cache_hash(const ihash_elem_t *, void *);
+static bool cache_less(const ihash_elem_t *, const ihash_elem_t *, void *);
 static cache_entry_t *cache_get(block_sector_t, lock_mode_t);
 static void cache_release(cache_entry_t *);
 static void cache_pin(cache_entry_t *);
@@ -179,12 +206,25 @@ static uint8_t *free_map_sec_to_buf(block_sector_t sector) {
 /*! Initializes the file system cache. Helper for fs_disk_init(). Because the
     cache does not require */
 static void fs_cache_init(void) {
-    if (!hash_init(&cache, cache_hash, cache_less, NULL)) {
+    if (!ihash_init(&cache, cache_hash, cache_less, NULL)) {
         PANIC("Could not initialize file system cache.");
     }
     cache_closed = false;
-    for (size_t i = 0; i < CACHE_SECTORS; i++) {
-        entry_init(&entries[i]);
+    size_t page_cnt = DIV_ROUND_UP(fs_cache_sectors, ENTRIES_PER_PAGE);
+    entry_pages = malloc(page_cnt * sizeof *entry_pages);
+    if (entry_pages == NULL) {
+        PANIC("Could not allocate %zu file system cache sectors.",
+              fs_cache_sectors);
+    }
+    for (size_t i = 0; i < page_cnt; i++) {
+        entry_pages[i] = palloc_get_page(0);
+        if (entry_pages[i] == NULL) {
+            PANIC("Could not allocate %zu file system cache sectors.",
+                  fs_cache_sectors);
+        }
+    }
+    for (size_t i = 0; i < fs_cache_sectors; i++) {
+        entry_init(entry_at(i));
     }
     ASSERT(bitmap_buf_size(fs_disk_size()) <= FREE_MAP_BUF_SIZE);
     free_map_sectors = 
@@ -194,7 +234,9 @@ static void fs_cache_init(void) {
         fs_disk_read(i, free_map_sec_to_buf(i));
     }
     lock_init(&cache_lock);
+    lock_set_name(&cache_lock, "cache_lock");
     lock_init(&free_map_lock);
+    lock_set_name(&free_map_lock, "free_map_lock");
     write_behind_start();
     read_ahead_start();
 }
@@ -217,8 +259,8 @@ void fs_disk_close(void) {
     If blocking is false, any entries that are in use when it is their turn to
     be cleaned will be skipped. */
 void fs_cache_flush(bool blocking) {
-    for (size_t i = 0; i < CACHE_SECTORS; i++) {
-        cache_entry_t *entry = &entries[i];
+    for (size_t i = 0; i < fs_cache_sectors; i++) {
+        cache_entry_t *entry = entry_at(i);
         if (blocking) {
             cache_pin(entry);
             cache_clean(entry);
@@ -241,6 +283,7 @@ void fs_cache_flush(bool blocking) {
 
 /*! Destroys the file system cache, flushing it. */
 static void fs_cache_destroy(void) {
+    ktimer_cancel(&write_behind_timer);
     free_map_dirty = true;
     fs_cache_flush(true);
     cache_closed = true;
@@ -349,10 +392,23 @@ void *fs_cache_get_free_map_buf(void) {
     return free_map_buffer;
 }
 
+/*! Formats the cache's statistics into the SIZE bytes of BUF. Returns the
+    number of bytes written, not counting the null terminator. */
+size_t fs_cache_stats_format(char *buf, size_t size) {
+    lock_acquire(&cache_lock);
+    int len = snprintf(buf, size, "%zu of %zu sectors cached, %llu lookups, "
+                       "%llu misses, %llu evictions\n", ihash_size(&cache),
+                       fs_cache_sectors, cache_lookups, cache_misses,
+                       cache_evictions);
+    lock_release(&cache_lock);
+    if (size == 0) return 0;
+    return (size_t) len < size ? (size_t) len : size - 1;
+}
+
 /*! Converts pointer to hash elem embeded in cache entry to pointer to that
     cache entry. */
-static inline cache_entry_t *cache_entry(const hash_elem_t *e) {
-    return hash_entry(e, cache_entry_t, elem);
+static inline cache_entry_t *cache_entry(const ihash_elem_t *e) {
+    return ihash_entry(e, cache_entry_t, elem);
 }
 
 /*! Flushes a cache entry to the disk. Since this can perform a disk operation,
@@ -367,11 +423,11 @@ static void cache_clean(cache_entry_t *entry) {
     rw_read_release(&entry->lock);
 }
 /*! Computes the hash of a cache entry. */
-static unsigned cache_hash(const hash_elem_t *e, void *aux UNUSED) {
+static unsigned cache_hash(const ihash_elem_t *e, void *aux UNUSED) {
     return hash_int(cache_entry(e)->sector);
 }
 /*! A total order on cache entries. */
-static bool cache_less(const hash_elem_t *a, const hash_elem_t *b,
+static bool cache_less(const ihash_elem_t *a, const ihash_elem_t *b,
                        void *aux UNUSED) {
     return cache_entry(a)->sector < cache_entry(b)->sector;
 }
@@ -383,9 +439,10 @@ static cache_entry_t *cache_get(block_sector_t sector, lock_mode_t mode) {
     ASSERT(!is_free_map_sec(sector));
     cache_entry_t lookup = {.sector = sector};
     lock_acquire(&cache_lock);
+    cache_lookups++;
     cache_entry_t *entry;
     do {
-        entry = cache_entry(hash_find(&cache, &lookup.elem));
+        entry = cache_entry(ihash_find(&cache, &lookup.elem));
         if (entry != NULL && !cache_try_pin(entry)) {
             // if the entry is currently being evicted, wait for that to
             // finish, then continue.
@@ -397,6 +454,8 @@ static cache_entry_t *cache_get(block_sector_t sector, lock_mode_t mode) {
             continue;
         }
         if (entry == NULL) {
+            TRACE(TRACE_CACHE_MISS, sector, 0, 0);
+            cache_misses++;
             entry = cache_set(cache_get_free(), sector);
         }
     } while (entry == NULL);
@@ -477,8 +536,9 @@ static cache_entry_t *entry_to_evict(void) {
     static size_t clock_hand = 0;
     // We don't lock the clock hand because we don't really care if it fails to
     // increment occasionally, which is the only race-y interleaving.
-    for (size_t i = clock_hand++ % CACHE_SECTORS;; i = (i+1) % CACHE_SECTORS) {
-        cache_entry_t *entry = &entries[i];
+    for (size_t i = clock_hand++ % fs_cache_sectors;;
+         i = (i + 1) % fs_cache_sectors) {
+        cache_entry_t *entry = entry_at(i);
         // entry is being used by someone, skip it.
         if (!cache_try_pin_evict(entry)) continue;
 
@@ -516,7 +576,9 @@ static cache_entry_t *cache_get_free(void) {
     ASSERT(lock_held_by_current_thread(&entry->evict));
     ASSERT(entry->free || entry->last_accessed == NEVER_ACCESSED);
     if (!entry->free) {
-        ASSERT(hash_delete(&cache, &entry->elem) == &entry->elem);
+        TRACE(TRACE_CACHE_EVICT, entry->sector, 0, 0);
+        cache_evictions++;
+        ASSERT(ihash_delete(&cache, &entry->elem) == &entry->elem);
         entry->free = true;
     }
     ASSERT(entry->dirty == false);
@@ -530,6 +592,7 @@ static void entry_init(cache_entry_t *entry) {
     entry->pin_count = 0;
     entry->free = true;
     rw_init(&entry->lock);
+    rw_set_name(&entry->lock, "cache entry");
     lock_init(&entry->evict);
     lock_init(&entry->can_read_lock);
 }
@@ -553,7 +616,7 @@ static cache_entry_t *cache_set(cache_entry_t *entry, block_sector_t sector) {
     entry->pin_count = 1;
 
     cache_entry_t *ret;
-    if (hash_insert(&cache, &entry->elem) != NULL) {
+    if (ihash_insert(&cache, &entry->elem) != NULL) {
         entry->pin_count = 0;
         ret = NULL;
     } else {
@@ -583,20 +646,18 @@ static void cache_set_can_read(cache_entry_t *entry) {
 }
 
 /*! Helper for write-behind functionality of the cache; flushes the cache to
-    disk FLUSH_FREQ times per second. */
-static void write_behind_helper(void *aux UNUSED) {
-    const int64_t FLUSH_FREQ = 10;
-    const int64_t FLUSH_PERIOD = TIMER_FREQ / FLUSH_FREQ;
-    while (true) {
-        timer_sleep(FLUSH_PERIOD);
-        if (cache_closed) break;
-        fs_cache_flush(false);
-    }
+    disk and sets TIMER to do so again after another flush period. Runs in the
+    timer thread. */
+static void write_behind_helper(ktimer_t *timer, void *aux UNUSED) {
+    if (cache_closed) return;
+    fs_cache_flush(false);
+    ktimer_set(timer, timer_ticks() + fs_flush_period);
 }
 
 /*! Starts the write behind system. */
 static void write_behind_start(void) {
-    thread_create("write behind", PRI_DEFAULT, write_behind_helper, NULL);
+    ktimer_init_deferred(&write_behind_timer, write_behind_helper, NULL);
+    ktimer_set(&write_behind_timer, timer_ticks() + fs_flush_period);
 }
 
 /*! Helper for read-ahead functionality. Dequeues read ahead requests and reads
@@ -615,7 +676,7 @@ static void read_ahead_helper(void *aux UNUSED) {
 /*! Starts the read ahead system. */
 static void read_ahead_start(void) {
     read_ahead_head = read_ahead_tail = 0;
-    sema_init(&read_ahead_free, READ_AHEAD_QUEUE_SIZE);
+    sema_init(&read_ahead_free, fs_read_ahead_size);
     sema_init(&read_ahead_used, 0);
     lock_init(&read_ahead_lock);
     thread_create("read ahead", PRI_DEFAULT, read_ahead_helper, NULL);
@@ -629,7 +690,7 @@ static void read_ahead_enqueue(block_sector_t sector) {
     lock_acquire(&read_ahead_lock);
     if (sema_try_down(&read_ahead_free)) {
         read_ahead_queue[read_ahead_tail] = sector;
-        read_ahead_tail = (read_ahead_tail + 1) % READ_AHEAD_QUEUE_SIZE;
+        read_ahead_tail = (read_ahead_tail + 1) % fs_read_ahead_size;
         sema_up(&read_ahead_used);
     }
     lock_release(&read_ahead_lock);
@@ -641,7 +702,7 @@ static block_sector_t read_ahead_dequeue(void) {
     sema_down(&read_ahead_used);
     lock_acquire(&read_ahead_lock);
     sector = read_ahead_queue[read_ahead_head];
-    read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE_SIZE;
+    read_ahead_head = (read_ahead_head + 1) % fs_read_ahead_size;
     sema_up(&read_ahead_free);
     lock_release(&read_ahead_lock);
     return sector;
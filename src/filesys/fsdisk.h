@@ -10,6 +10,15 @@
 #define MAX_FREE_MAP_SIZE BITMAP_BUF_SIZE(MAX_DISK_SIZE / BLOCK_SECTOR_SIZE)
 #define FREE_MAP_BUF_SIZE ROUND_UP(MAX_FREE_MAP_SIZE, BLOCK_SECTOR_SIZE)
 
+/*! Largest size of the read-ahead queue. */
+#define FS_READ_AHEAD_MAX 64
+
+/*! Tunables. @{ */
+extern size_t fs_cache_sectors;
+extern size_t fs_read_ahead_size;
+extern size_t fs_flush_period;
+/*! @} */
+
 void fs_disk_init(void);
 void fs_disk_close(void);
 block_sector_t fs_disk_size(void);
@@ -38,6 +47,8 @@ void fs_cache_read(block_sector_t, void *);
 void *fs_cache_get(block_sector_t, uint32_t flags);
 void fs_cache_release(void *);
 
+size_t fs_cache_stats_format(char *buf, size_t size);
+
 void *fs_cache_get_free_map_buf(void);
 
 void fs_request_read_ahead(block_sector_t);
@@ -6,7 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/fsdisk.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/interrupt.h"
 
 #include "stdio.h"
@@ -174,11 +174,15 @@ static block_sector_t byte_to_sector(inode_t *inode, off_t pos, bool create) {
 static list_t open_inodes;
 /*! Lock to synchronize use of open_inodes. */
 static lock_t open_lock;
+/*! Cache from which inodes are allocated. */
+static kmem_cache_t *inode_cache;
 
 /*! Initializes the inode module. */
 void inode_init(void) {
     list_init(&open_inodes);
     lock_init(&open_lock);
+    lock_set_name(&open_lock, "open_lock");
+    inode_cache = kmem_cache_create("inode", sizeof(struct inode), NULL);
 }
 
 /*! Initializes an inode with LENGTH bytes of data and
@@ -226,7 +230,7 @@ inode_t* inode_open(block_sector_t sector) {
     }
 
     /* Allocate memory. */
-    inode = malloc(sizeof *inode);
+    inode = kmem_cache_alloc(inode_cache);
     if (inode == NULL)
         goto exit;
 
@@ -236,6 +240,7 @@ inode_t* inode_open(block_sector_t sector) {
     inode->deny_write_cnt = 0;
     inode->removed = false;
     rw_init(&inode->lock);
+    rw_set_name(&inode->lock, "inode");
     list_push_front(&open_inodes, &inode->elem);
     exit:
     lock_release(&open_lock);
@@ -300,7 +305,7 @@ void inode_close(inode_t *inode) {
             free_map_release(inode->sector, 1);
         }
 
-        free(inode); 
+        kmem_cache_free(inode_cache, inode);
     }
 }
 
@@ -0,0 +1,180 @@
+/*! \file procfs.c
+
+   Virtual statistics files. Paths in PROCFS_DIR which name one of the files
+   below are not looked up on disk: opening one renders the statistics it
+   describes, as they are at that moment, into a read-only text file. A
+   monitoring program can thus poll kernel statistics with open, read and
+   close. The directory itself exists only in the names of its files, so it
+   cannot be opened or listed, and a name which is not one of the files below
+   is looked up on disk as usual. */
+
+#include "filesys/procfs.h"
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/ide.h"
+#include "filesys/fsdisk.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tune.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/filemap.h"
+#include "userprog/syscall.h"
+#include "vm/mappings.h"
+#endif
+
+/*! Formats statistics into the SIZE bytes of BUF, returning the number of
+    bytes written, not counting the null terminator. */
+typedef size_t procfs_format_func(char *buf, size_t size);
+
+static size_t loadavg_format(char *buf, size_t size);
+static size_t usage_format(char *buf, size_t size);
+#ifdef USERPROG
+static size_t files_format(char *buf, size_t size);
+#endif
+#ifdef VM
+static size_t memory_format(char *buf, size_t size);
+#endif
+
+/*! The virtual files, by name within PROCFS_DIR. */
+static const struct {
+    const char *name;
+    procfs_format_func *format;
+} files[] = {
+    { "loadavg", loadavg_format },
+    { "cache", fs_cache_stats_format },
+    { "block", block_stats_format },
+    { "ide", ide_stats_format },
+    { "trace", trace_format },
+    { "tunables", tune_format },
+#ifdef LOCK_PROFILE
+    { "locks", lock_stats_format },
+#endif
+    { "self/usage", usage_format },
+#ifdef USERPROG
+    { "self/files", files_format },
+    { "self/syscalls", syscall_stats_format },
+#endif
+#ifdef VM
+    { "self/memory", memory_format },
+#endif
+};
+
+/*! If PATH names a virtual file, opens it into *FILE, which is set to NULL
+    if memory is not available, and returns true. Returns false if PATH is
+    not a virtual file. */
+bool procfs_open(const char *path, file_t **file) {
+    size_t dir_len = strlen(PROCFS_DIR);
+    if (strncmp(path, PROCFS_DIR, dir_len)) return false;
+
+    for (size_t i = 0; i < sizeof files / sizeof *files; i++) {
+        if (!strcmp(path + dir_len, files[i].name)) {
+            char *page = palloc_get_page(0);
+            *file = NULL;
+            if (page != NULL) {
+                *file = file_open_text(page, files[i].format(page, PGSIZE));
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/*! Returns the number of bytes snprintf() wrote into a buffer of SIZE
+    bytes, given that it returned LEN. */
+static size_t written(int len, size_t size) {
+    if (size == 0 || len < 0) return 0;
+    return (size_t) len < size ? (size_t) len : size - 1;
+}
+
+/*! Formats the scheduler's load average. */
+static size_t loadavg_format(char *buf, size_t size) {
+    int load_avg = thread_get_load_avg();
+    return written(snprintf(buf, size, "%d.%02d\n", load_avg / 100,
+                            load_avg % 100), size);
+}
+
+/*! Formats the resources used by the current thread. */
+static size_t usage_format(char *buf, size_t size) {
+    enum intr_level old_level = intr_disable();
+    struct rusage u = thread_current()->usage;
+    intr_set_level(old_level);
+
+    return written(snprintf(buf, size, "%llu user ticks, %llu kernel ticks\n"
+                            "%llu page faults, %llu swap-ins\n"
+                            "%llu bytes read, %llu bytes written\n"
+                            "%llu voluntary, %llu involuntary switches\n",
+                            u.user_ticks, u.kernel_ticks, u.page_faults,
+                            u.swap_ins, u.bytes_read, u.bytes_written,
+                            u.voluntary_switches, u.involuntary_switches),
+                   size);
+}
+
+#ifdef USERPROG
+/*! A buffer being filled by files_format(). */
+struct files_buf {
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+/*! Appends a line describing FILE to the files_buf AUX. */
+static void file_line(file_t *file, void *aux) {
+    struct files_buf *b = aux;
+    inode_t *inode = file_get_inode(file);
+    if (b->len + 1 >= b->size) return;
+    if (inode != NULL) {
+        b->len += written(snprintf(b->buf + b->len, b->size - b->len,
+                                   "file inode %u, %d bytes, at %d\n",
+                                   (unsigned) inode_get_inumber(inode),
+                                   file_length(file), file_tell(file)),
+                          b->size - b->len);
+    } else {
+        b->len += written(snprintf(b->buf + b->len, b->size - b->len,
+                                   "text, %d bytes, at %d\n",
+                                   file_length(file), file_tell(file)),
+                          b->size - b->len);
+    }
+}
+
+/*! Appends a line describing DIR to the files_buf AUX. */
+static void dir_line(dir_t *dir, void *aux) {
+    struct files_buf *b = aux;
+    if (b->len + 1 >= b->size) return;
+    b->len += written(snprintf(b->buf + b->len, b->size - b->len,
+                               "dir inode %u\n", (unsigned)
+                               inode_get_inumber(dir_get_inode(dir))),
+                      b->size - b->len);
+}
+
+/*! Formats a line for each file and directory the current process has
+    open. Kernel threads have none. */
+static size_t files_format(char *buf, size_t size) {
+    struct files_buf b = { .buf = buf, .size = size, .len = 0 };
+    thread_t *cur = thread_current();
+    if (size > 0) buf[0] = '\0';
+    if (!sup_pt_is_kernel(&cur->pt)) {
+        filemap_foreach(&cur->file_map, file_line, dir_line, &b);
+    }
+    return b.len;
+}
+#endif
+
+#ifdef VM
+/*! Formats the numbers of the current process's pages in each state. Kernel
+    threads have no user pages. */
+static size_t memory_format(char *buf, size_t size) {
+    vm_page_counts_t c = { 0 };
+    sup_pagetable_t *pt = &thread_current()->pt;
+    if (!sup_pt_is_kernel(pt)) vm_count_pages(pt, &c);
+    return written(snprintf(buf, size, "mapped %zu\ntouched %zu\n"
+                            "present %zu\nzero %zu\nswapped %zu\nfile %zu\n",
+                            c.mapped, c.touched, c.present, c.zero,
+                            c.swapped, c.file), size);
+}
+#endif
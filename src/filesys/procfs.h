@@ -0,0 +1,12 @@
+#ifndef FILESYS_PROCFS_H
+#define FILESYS_PROCFS_H
+
+#include <stdbool.h>
+#include "filesys/file.h"
+
+/*! Directory in which the virtual statistics files appear. */
+#define PROCFS_DIR "/proc/"
+
+bool procfs_open(const char *path, file_t **file);
+
+#endif /* filesys/procfs.h */
@@ -0,0 +1,27 @@
+/*! \file kdata.h
+ *
+ * The kernel data page, which the kernel maps read-only into every user
+ * process and keeps up to date, so that user programs can read the time
+ * without a system call.
+ */
+
+#ifndef __LIB_KDATA_H
+#define __LIB_KDATA_H
+
+/*! User virtual address of the kernel data page, below the programs' code. */
+#define KDATA_ADDR 0x08000000
+
+/*! Contents of the kernel data page.
+
+    The kernel increments seq before and after each update, so it is odd
+    while an update is underway. A reader must read seq, then the fields,
+    then seq again, and retry if the two reads of seq differ or are odd. */
+struct kdata {
+    unsigned seq;               /*!< Update sequence number. */
+    unsigned ticks_per_sec;     /*!< Timer ticks per second. */
+    long long ticks;            /*!< Timer ticks since boot. */
+    int load_avg;               /*!< Load average, times 100. */
+    unsigned long boot_time;    /*!< Seconds since the Unix epoch at boot. */
+};
+
+#endif /* lib/kdata.h */
@@ -0,0 +1,306 @@
+/* Balanced binary search tree.
+
+   See avl.h for basic information. */
+
+#include "avl.h"
+
+static int height (const struct avl_elem *);
+static struct avl_elem *rebalance (struct avl_elem *);
+static struct avl_elem *insert_elem (struct avl *, struct avl_elem *,
+                                     struct avl_elem *,
+                                     struct avl_elem **found);
+static struct avl_elem *delete_elem (struct avl *, struct avl_elem *,
+                                     const struct avl_elem *,
+                                     struct avl_elem **found);
+static void destroy_elem (struct avl *, struct avl_elem *,
+                          avl_action_func *);
+
+/* Initializes tree T to compare elements using LESS, given
+   auxiliary data AUX. */
+void
+avl_init (struct avl *t, avl_less_func *less, void *aux)
+{
+  t->root = NULL;
+  t->elem_cnt = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Removes all the elements from T.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the tree, children before their parents.  DESTRUCTOR may,
+   if appropriate, deallocate the memory used by the tree
+   element.  Modifying T while avl_destroy() is running yields
+   undefined behavior. */
+void
+avl_destroy (struct avl *t, avl_action_func *destructor)
+{
+  struct avl_elem *root = t->root;
+
+  t->root = NULL;
+  t->elem_cnt = 0;
+  destroy_elem (t, root, destructor);
+}
+
+/* Inserts NEW into tree T and returns a null pointer, if no
+   equal element is already in the tree.
+   If an equal element is already in the tree, returns it
+   without inserting NEW. */
+struct avl_elem *
+avl_insert (struct avl *t, struct avl_elem *new)
+{
+  struct avl_elem *found = NULL;
+
+  t->root = insert_elem (t, t->root, new, &found);
+  if (found == NULL)
+    t->elem_cnt++;
+  return found;
+}
+
+/* Finds and returns an element equal to E in tree T, or a null
+   pointer if no equal element exists in the tree. */
+struct avl_elem *
+avl_find (struct avl *t, const struct avl_elem *e)
+{
+  struct avl_elem *cur = t->root;
+
+  while (cur != NULL)
+    {
+      if (t->less (e, cur, t->aux))
+        cur = cur->left;
+      else if (t->less (cur, e, t->aux))
+        cur = cur->right;
+      else
+        return cur;
+    }
+  return NULL;
+}
+
+/* Finds and returns the greatest element in tree T which is not
+   greater than E, or a null pointer if every element is greater
+   than E. */
+struct avl_elem *
+avl_floor (struct avl *t, const struct avl_elem *e)
+{
+  struct avl_elem *cur = t->root;
+  struct avl_elem *best = NULL;
+
+  while (cur != NULL)
+    {
+      if (t->less (e, cur, t->aux))
+        cur = cur->left;
+      else
+        {
+          best = cur;
+          cur = cur->right;
+        }
+    }
+  return best;
+}
+
+/* Finds and returns the least element in tree T which is not
+   less than E, or a null pointer if every element is less than
+   E. */
+struct avl_elem *
+avl_ceil (struct avl *t, const struct avl_elem *e)
+{
+  struct avl_elem *cur = t->root;
+  struct avl_elem *best = NULL;
+
+  while (cur != NULL)
+    {
+      if (t->less (cur, e, t->aux))
+        cur = cur->right;
+      else
+        {
+          best = cur;
+          cur = cur->left;
+        }
+    }
+  return best;
+}
+
+/* Finds, removes, and returns an element equal to E in tree T.
+   Returns a null pointer if no equal element existed in the
+   tree.
+
+   If the elements of the tree are dynamically allocated, or own
+   resources that are, then it is the caller's responsibility to
+   deallocate them. */
+struct avl_elem *
+avl_delete (struct avl *t, const struct avl_elem *e)
+{
+  struct avl_elem *found = NULL;
+
+  t->root = delete_elem (t, t->root, e, &found);
+  if (found != NULL)
+    t->elem_cnt--;
+  return found;
+}
+
+/* Returns the number of elements in T. */
+size_t
+avl_size (struct avl *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+avl_empty (struct avl *t)
+{
+  return t->elem_cnt == 0;
+}
+
+/* Returns the height of the subtree rooted at E. */
+static int
+height (const struct avl_elem *e)
+{
+  return e != NULL ? e->height : 0;
+}
+
+/* Recomputes the height of E from its children. */
+static void
+update_height (struct avl_elem *e)
+{
+  int l = height (e->left);
+  int r = height (e->right);
+
+  e->height = (l > r ? l : r) + 1;
+}
+
+/* Rotates the subtree rooted at E to the left and returns its
+   new root. */
+static struct avl_elem *
+rotate_left (struct avl_elem *e)
+{
+  struct avl_elem *r = e->right;
+
+  e->right = r->left;
+  r->left = e;
+  update_height (e);
+  update_height (r);
+  return r;
+}
+
+/* Rotates the subtree rooted at E to the right and returns its
+   new root. */
+static struct avl_elem *
+rotate_right (struct avl_elem *e)
+{
+  struct avl_elem *l = e->left;
+
+  e->left = l->right;
+  l->right = e;
+  update_height (e);
+  update_height (l);
+  return l;
+}
+
+/* Restores the balance of the subtree rooted at E, whose
+   children are balanced and differ in height by at most two, and
+   returns its new root. */
+static struct avl_elem *
+rebalance (struct avl_elem *e)
+{
+  int balance = height (e->left) - height (e->right);
+
+  if (balance > 1)
+    {
+      if (height (e->left->left) < height (e->left->right))
+        e->left = rotate_left (e->left);
+      return rotate_right (e);
+    }
+  else if (balance < -1)
+    {
+      if (height (e->right->right) < height (e->right->left))
+        e->right = rotate_right (e->right);
+      return rotate_left (e);
+    }
+  update_height (e);
+  return e;
+}
+
+/* Inserts NEW into the subtree of T rooted at E and returns the
+   subtree's new root.  If an equal element is already present,
+   stores it in *FOUND and leaves the subtree unchanged. */
+static struct avl_elem *
+insert_elem (struct avl *t, struct avl_elem *e, struct avl_elem *new,
+             struct avl_elem **found)
+{
+  if (e == NULL)
+    {
+      new->left = new->right = NULL;
+      new->height = 1;
+      return new;
+    }
+
+  if (t->less (new, e, t->aux))
+    e->left = insert_elem (t, e->left, new, found);
+  else if (t->less (e, new, t->aux))
+    e->right = insert_elem (t, e->right, new, found);
+  else
+    {
+      *found = e;
+      return e;
+    }
+  return rebalance (e);
+}
+
+/* Removes the least element from the subtree rooted at E, stores
+   it in *MIN, and returns the subtree's new root. */
+static struct avl_elem *
+delete_min (struct avl_elem *e, struct avl_elem **min)
+{
+  if (e->left == NULL)
+    {
+      *min = e;
+      return e->right;
+    }
+  e->left = delete_min (e->left, min);
+  return rebalance (e);
+}
+
+/* Removes an element equal to KEY from the subtree of T rooted
+   at E, stores it in *FOUND, and returns the subtree's new
+   root. */
+static struct avl_elem *
+delete_elem (struct avl *t, struct avl_elem *e, const struct avl_elem *key,
+             struct avl_elem **found)
+{
+  if (e == NULL)
+    return NULL;
+
+  if (t->less (key, e, t->aux))
+    e->left = delete_elem (t, e->left, key, found);
+  else if (t->less (e, key, t->aux))
+    e->right = delete_elem (t, e->right, key, found);
+  else
+    {
+      struct avl_elem *min;
+
+      *found = e;
+      if (e->right == NULL)
+        return e->left;
+      e->right = delete_min (e->right, &min);
+      min->left = e->left;
+      min->right = e->right;
+      e = min;
+    }
+  return rebalance (e);
+}
+
+/* Calls DESTRUCTOR, if non-null, on each element of the subtree
+   of T rooted at E, children first. */
+static void
+destroy_elem (struct avl *t, struct avl_elem *e, avl_action_func *destructor)
+{
+  if (e == NULL)
+    return;
+
+  destroy_elem (t, e->left, destructor);
+  destroy_elem (t, e->right, destructor);
+  if (destructor != NULL)
+    destructor (e, t->aux);
+}
@@ -0,0 +1,75 @@
+#ifndef __LIB_KERNEL_AVL_H
+#define __LIB_KERNEL_AVL_H
+
+/* Balanced binary search tree.
+
+   This is an AVL tree: for every element, the heights of its
+   two subtrees differ by at most one, so lookups, insertions and
+   deletions all take O(log n) time.  Unlike a hash table, it
+   keeps its elements in order, so it can also answer "which
+   element is the greatest one not greater than X" queries, which
+   is what is needed to find the range containing an address.
+
+   Like lists and hash tables, the tree does not use dynamic
+   allocation.  Each structure that can potentially be in a tree
+   must embed a struct avl_elem member, and the avl_entry macro
+   converts from a struct avl_elem back to the structure that
+   contains it.  See lib/kernel/list.h for a detailed explanation
+   of the technique. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+typedef struct avl_elem
+  {
+    struct avl_elem *left;      /* Lesser elements. */
+    struct avl_elem *right;     /* Greater elements. */
+    int height;                 /* Height of the subtree rooted here. */
+  } avl_elem_t;
+
+/* Converts pointer to tree element AVL_ELEM into a pointer to
+   the structure that AVL_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define avl_entry(AVL_ELEM, STRUCT, MEMBER)                     \
+        ((STRUCT *) ((uint8_t *) &(AVL_ELEM)->height            \
+                     - offsetof (STRUCT, MEMBER.height)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool avl_less_func (const struct avl_elem *a,
+                            const struct avl_elem *b,
+                            void *aux);
+
+/* Performs some operation on tree element E, given auxiliary
+   data AUX. */
+typedef void avl_action_func (struct avl_elem *e, void *aux);
+
+/* Tree. */
+typedef struct avl
+  {
+    struct avl_elem *root;      /* Root element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in tree. */
+    avl_less_func *less;        /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  } avl_t;
+
+/* Basic life cycle. */
+void avl_init (struct avl *, avl_less_func *, void *aux);
+void avl_destroy (struct avl *, avl_action_func *);
+
+/* Search, insertion, deletion. */
+struct avl_elem *avl_insert (struct avl *, struct avl_elem *);
+struct avl_elem *avl_find (struct avl *, const struct avl_elem *);
+struct avl_elem *avl_floor (struct avl *, const struct avl_elem *);
+struct avl_elem *avl_ceil (struct avl *, const struct avl_elem *);
+struct avl_elem *avl_delete (struct avl *, const struct avl_elem *);
+
+/* Information. */
+size_t avl_size (struct avl *);
+bool avl_empty (struct avl *);
+
+#endif /* lib/kernel/avl.h */
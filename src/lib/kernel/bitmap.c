@@ -46,6 +46,168 @@ last_mask (const bitmap_t *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type in which the CNT bits starting at bit OFS
+   are turned on.  CNT must be nonzero and OFS + CNT must not
+   exceed ELEM_BITS. */
+static inline elem_type
+span_mask (size_t ofs, size_t cnt)
+{
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1;
+  return mask << ofs;
+}
+
+/* Returns the index of the lowest bit that is turned on in X,
+   which must be nonzero.  See the description of the BSF
+   instruction in [IA32-v2a]. */
+static inline size_t
+lowest_bit (elem_type x)
+{
+  elem_type idx;
+  asm ("bsf %1, %0" : "=r" (idx) : "rm" (x) : "cc");
+  return idx;
+}
+
+/* Returns the index of the highest bit that is turned on in X,
+   which must be nonzero.  See the description of the BSR
+   instruction in [IA32-v2a]. */
+static inline size_t
+highest_bit (elem_type x)
+{
+  elem_type idx;
+  asm ("bsr %1, %0" : "=r" (idx) : "rm" (x) : "cc");
+  return idx;
+}
+
+/* Returns the number of bits that are turned on in X. */
+static inline size_t
+count_bits (elem_type x)
+{
+  size_t cnt = 0;
+  for (; x != 0; x &= x - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Summaries.
+
+   Summaries are not stored in struct bitmap, whose layout is
+   also the on-disk header of the free map, but in this small
+   table.  Only a few long-lived bitmaps have one, so finding it
+   by a linear search is cheap. */
+#define SUMMARY_CNT 4
+
+static struct
+  {
+    const bitmap_t *map;        /* Bitmap, or null if slot is free. */
+    elem_type *bits;            /* Its summary. */
+  }
+summaries[SUMMARY_CNT];
+
+/* Returns the index of the table slot for bitmap B, or
+   SUMMARY_CNT if there is none.  A null B finds a free slot. */
+static inline size_t
+summary_slot (const bitmap_t *b)
+{
+  size_t i;
+
+  for (i = 0; i < SUMMARY_CNT; i++)
+    if (summaries[i].map == b)
+      break;
+  return i;
+}
+
+/* Returns B's summary, or a null pointer if B has none. */
+static inline elem_type *
+summary_of (const bitmap_t *b)
+{
+  size_t i = summary_slot (b);
+  return i < SUMMARY_CNT ? summaries[i].bits : NULL;
+}
+
+/* Updates the bit for element IDX of B in SUMMARY, which is B's
+   summary or a null pointer if B has none. */
+static inline void
+update_summary (const bitmap_t *b, elem_type *summary, size_t idx)
+{
+  if (summary != NULL)
+    {
+      elem_type bits = b->bits[idx];
+      if (idx == elem_cnt (b->bit_cnt) - 1)
+        bits |= ~last_mask (b);
+      if (bits == (elem_type) -1)
+        summary[elem_idx (idx)] |= bit_mask (idx);
+      else
+        summary[elem_idx (idx)] &= ~bit_mask (idx);
+    }
+}
+
+/* Recomputes every bit of B's summary, if it has one. */
+static void
+rebuild_summary (const bitmap_t *b)
+{
+  elem_type *summary = summary_of (b);
+  size_t i;
+
+  if (summary != NULL)
+    for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+      update_summary (b, summary, i);
+}
+
+/* Returns the index of the first element at or after IDX that
+   has a false bit, according to SUMMARY, or a value past LAST if
+   there is none before LAST. */
+static size_t
+skip_full (const elem_type *summary, size_t idx, size_t last)
+{
+  size_t s_idx = elem_idx (idx);
+  elem_type s = ~summary[s_idx] & ~(bit_mask (idx) - 1);
+
+  while (s == 0)
+    {
+      if (++s_idx > elem_idx (last))
+        return last + 1;
+      s = ~summary[s_idx];
+    }
+  return s_idx * ELEM_BITS + lowest_bit (s);
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.
+   Examines B an element at a time. */
+static size_t
+find_next (const bitmap_t *b, size_t start, size_t end, bool value)
+{
+  elem_type *summary;
+  size_t idx, last;
+  elem_type e;
+
+  if (start >= end)
+    return end;
+
+  summary = value ? NULL : summary_of (b);
+
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  e = (value ? b->bits[idx] : ~b->bits[idx]) & ~(bit_mask (start) - 1);
+  while (e == 0)
+    {
+      if (++idx > last)
+        return end;
+      if (summary != NULL)
+        {
+          idx = skip_full (summary, idx, last);
+          if (idx > last)
+            return end;
+        }
+      e = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  /* Bits past END, including any past the end of B, may have
+     matched. */
+  idx = idx * ELEM_BITS + lowest_bit (e);
+  return idx < end ? idx : end;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -80,6 +242,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
+  bitmap_disable_summary (b);
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
@@ -90,6 +253,52 @@ size_t bitmap_buf_size (size_t bit_cnt) {
   return sizeof (bitmap_t) + sizeof (elem_type) * elem_cnt(bit_cnt);
 }
 
+/* Gives B a summary of which of its elements are full, so that
+   searches for false bits can skip over them quickly, and returns
+   true if successful or false if memory allocation fails or too
+   many bitmaps already have summaries.  The summary is updated
+   along with B's bits, but not atomically with them, so if B has
+   a summary then it must not be modified by different threads at
+   once without synchronization.  Summaries must be enabled and
+   disabled at initialization or otherwise not concurrently.
+
+   The summary is allocated separately from B, so it must be freed
+   with bitmap_destroy(), or with bitmap_disable_summary() if B was
+   created by bitmap_create_in_buf(). */
+bool
+bitmap_enable_summary (bitmap_t *b)
+{
+  size_t cnt = elem_cnt (elem_cnt (b->bit_cnt));
+  size_t i;
+
+  bitmap_disable_summary (b);
+  if (cnt == 0)
+    return true;
+  i = summary_slot (NULL);
+  if (i == SUMMARY_CNT)
+    return false;
+  summaries[i].bits = calloc (cnt, sizeof *summaries[i].bits);
+  if (summaries[i].bits == NULL)
+    return false;
+  summaries[i].map = b;
+  rebuild_summary (b);
+  return true;
+}
+
+/* Frees B's summary, if it has one. */
+void
+bitmap_disable_summary (bitmap_t *b)
+{
+  size_t i = summary_slot (b);
+
+  if (i < SUMMARY_CNT)
+    {
+      free (summaries[i].bits);
+      summaries[i].map = NULL;
+      summaries[i].bits = NULL;
+    }
+}
+
 /* Destroys bitmap B, freeing its storage.
    Not for use on bitmaps created by bitmap_create_in_buf(). */
 void
@@ -97,6 +306,7 @@ bitmap_destroy (bitmap_t *b)
 {
   if (b != NULL)
     {
+      bitmap_disable_summary (b);
       free (b->bits);
       free (b);
     }
@@ -136,6 +346,7 @@ bitmap_mark (bitmap_t *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, summary_of (b), idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -149,6 +360,7 @@ bitmap_reset (bitmap_t *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, summary_of (b), idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -164,6 +376,7 @@ bitmap_flip (bitmap_t *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, summary_of (b), idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -186,18 +399,36 @@ bitmap_set_all (bitmap_t *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element of B is updated atomically, but the whole range
+   is not. */
 void
 bitmap_set_multiple (bitmap_t *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
+  size_t end = start + cnt;
+  elem_type *summary;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  summary = summary_of (b);
+
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type mask = span_mask (ofs, n);
+
+      /* See bitmap_mark() and bitmap_reset(). */
+      if (value)
+        asm ("orl %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "+m" (b->bits[idx]) : "r" (~mask) : "cc");
+      update_summary (b, summary, idx);
+      start += n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -205,16 +436,23 @@ bitmap_set_multiple (bitmap_t *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const bitmap_t *b, size_t start, size_t cnt, bool value)
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt = 0;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type e = value ? b->bits[idx] : ~b->bits[idx];
+
+      value_cnt += count_bits (e & span_mask (ofs, n));
+      start += n;
+    }
   return value_cnt;
 }
 
@@ -223,16 +461,11 @@ bitmap_count (const bitmap_t *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const bitmap_t *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
-
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -271,13 +504,23 @@ bitmap_scan (const bitmap_t *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt)
+  if (cnt == 0)
+    return start;
+  while (cnt <= b->bit_cnt - start)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i;
+      /* Find the next bit set to VALUE, then check whether the
+         run it starts is long enough.  If not, the search resumes
+         after the bit that ended the run, so each element is
+         examined about once. */
+      size_t end;
+
+      start = find_next (b, start, b->bit_cnt - cnt + 1, value);
+      if (start > b->bit_cnt - cnt)
+        break;
+      end = find_next (b, start, start + cnt, !value);
+      if (end == start + cnt)
+        return start;
+      start = end;
     }
   return BITMAP_ERROR;
 }
@@ -305,16 +548,8 @@ bitmap_lowest (const bitmap_t *b, bool value)
 {
   ASSERT (b != NULL);
 
-  elem_type empty = value ? 0 : -1;
-
-  size_t elem_count = elem_cnt(bitmap_size(b));
-
-  for (size_t i = 0; i < elem_count; i++)
-    if (b->bits[i] != empty)
-      for (size_t j = 0; j < ELEM_BITS; j++)
-        if (!!(b->bits[i] & bit_mask(j)) == value)
-          return i * ELEM_BITS + j;
-  return BITMAP_ERROR;
+  size_t idx = find_next (b, 0, b->bit_cnt, value);
+  return idx < b->bit_cnt ? idx : BITMAP_ERROR;
 }
 
 /* Finds the highest bit matching VALUE.
@@ -322,15 +557,18 @@ bitmap_lowest (const bitmap_t *b, bool value)
 size_t
 bitmap_highest (const bitmap_t *b, bool value)
 {
-  elem_type empty = value ? 0 : -1;
+  ASSERT (b != NULL);
 
-  size_t elem_count = elem_cnt(bitmap_size(b));
+  size_t idx = elem_cnt (b->bit_cnt);
 
-  for (size_t i = elem_count; i > 0; i--)
-    if (b->bits[i - 1] != empty)
-      for (size_t j = ELEM_BITS; j > 0; j--)
-        if (!!(b->bits[i - 1] & bit_mask(j - 1)) == value)
-          return (i - 1) * ELEM_BITS + j - 1;
+  while (idx-- > 0)
+    {
+      elem_type e = value ? b->bits[idx] : ~b->bits[idx];
+      if (idx == elem_cnt (b->bit_cnt) - 1)
+        e &= last_mask (b);
+      if (e != 0)
+        return idx * ELEM_BITS + highest_bit (e);
+    }
   return BITMAP_ERROR;
 }
 
@@ -355,6 +593,7 @@ bitmap_read (bitmap_t *b, file_t *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      rebuild_summary (b);
     }
   return success;
 }
@@ -20,7 +20,14 @@ typedef unsigned long elem_type;
 /* Bitmap abstract data type. */
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A bitmap may also have a summary, with one bit per element
+   which is set if every bit of the element is set.  Searches for
+   false bits use it to skip over full elements 32 at a time,
+   which helps large, mostly full maps such as allocators'.  The
+   summary is kept outside this structure, because a bitmap made
+   by bitmap_create_in_buf() may be written to disk as is. */
 typedef struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
@@ -39,6 +46,8 @@ typedef struct bitmap
 bitmap_t *bitmap_create (size_t bit_cnt);
 bitmap_t *bitmap_create_in_buf (size_t bit_cnt, void *, size_t byte_cnt);
 size_t bitmap_buf_size(size_t bit_cnt);
+bool bitmap_enable_summary (bitmap_t *);
+void bitmap_disable_summary (bitmap_t *);
 void bitmap_destroy (bitmap_t *);
 
 /* Bitmap size. */
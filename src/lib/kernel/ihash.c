@@ -0,0 +1,387 @@
+/* Incrementally resized hash table.
+
+   See ihash.h for basic information. */
+
+#include "ihash.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Number of buckets in a new table.  Tables never shrink below
+   this. */
+#define MIN_BUCKETS 8
+
+/* A table grows when it has more than this many elements per
+   bucket, and shrinks when it has fewer than one per this many
+   buckets. */
+#define MAX_ELEMS_PER_BUCKET 2
+#define MIN_BUCKETS_PER_ELEM 4
+
+/* Number of old buckets moved by each insertion or deletion
+   while the table is being resized.  This must be large enough
+   that a resize finishes before the table needs another. */
+#define MOVE_BUCKETS 4
+
+static struct ihash_elem **find_link (struct ihash *, struct ihash_elem *);
+static void insert_elem (struct ihash *, struct ihash_elem **,
+                         struct ihash_elem *);
+static void resize_step (struct ihash *);
+static struct ihash_elem **bucket_at (struct ihash *, size_t idx);
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool
+ihash_init (struct ihash *h,
+            ihash_hash_func *hash, ihash_less_func *less, void *aux)
+{
+  h->elem_cnt = 0;
+  h->bucket_cnt = MIN_BUCKETS;
+  h->buckets = calloc (h->bucket_cnt, sizeof *h->buckets);
+  h->old_bucket_cnt = 0;
+  h->old_buckets = NULL;
+  h->move_idx = 0;
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+
+  return h->buckets != NULL;
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while ihash_clear() is running, using any of the
+   functions ihash_clear(), ihash_destroy(), ihash_insert(),
+   ihash_replace(), or ihash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+ihash_clear (struct ihash *h, ihash_action_func *destructor)
+{
+  size_t i;
+
+  for (i = 0; i < h->old_bucket_cnt + h->bucket_cnt; i++)
+    {
+      struct ihash_elem **bucket = bucket_at (h, i);
+
+      if (destructor != NULL)
+        while (*bucket != NULL)
+          {
+            struct ihash_elem *e = *bucket;
+            *bucket = e->next;
+            destructor (e, h->aux);
+          }
+      *bucket = NULL;
+    }
+
+  free (h->old_buckets);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, as in ihash_clear(). */
+void
+ihash_destroy (struct ihash *h, ihash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ihash_clear (h, destructor);
+  free (h->old_buckets);
+  free (h->buckets);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */
+struct ihash_elem *
+ihash_insert (struct ihash *h, struct ihash_elem *new)
+{
+  struct ihash_elem **link = find_link (h, new);
+  struct ihash_elem *old = *link;
+
+  if (old == NULL)
+    {
+      insert_elem (h, link, new);
+      resize_step (h);
+    }
+
+  return old;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned. */
+struct ihash_elem *
+ihash_replace (struct ihash *h, struct ihash_elem *new)
+{
+  struct ihash_elem **link = find_link (h, new);
+  struct ihash_elem *old = *link;
+
+  if (old != NULL)
+    {
+      new->next = old->next;
+      *link = new;
+    }
+  else
+    {
+      insert_elem (h, link, new);
+      resize_step (h);
+    }
+
+  return old;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct ihash_elem *
+ihash_find (struct ihash *h, struct ihash_elem *e)
+{
+  return *find_link (h, e);
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct ihash_elem *
+ihash_delete (struct ihash *h, struct ihash_elem *e)
+{
+  struct ihash_elem **link = find_link (h, e);
+  struct ihash_elem *found = *link;
+
+  if (found != NULL)
+    {
+      *link = found->next;
+      h->elem_cnt--;
+      resize_step (h);
+    }
+  return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while ihash_apply() is running, using
+   any of the functions ihash_clear(), ihash_destroy(),
+   ihash_insert(), ihash_replace(), or ihash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+ihash_apply (struct ihash *h, ihash_action_func *action)
+{
+  size_t i;
+
+  ASSERT (action != NULL);
+
+  for (i = 0; i < h->old_bucket_cnt + h->bucket_cnt; i++)
+    {
+      struct ihash_elem *e, *next;
+
+      for (e = *bucket_at (h, i); e != NULL; e = next)
+        {
+          next = e->next;
+          action (e, h->aux);
+        }
+    }
+}
+
+/* Initializes I for iterating hash table H.
+
+   Iteration idiom:
+
+      struct ihash_iterator i;
+
+      ihash_first (&i, h);
+      while (ihash_next (&i))
+        {
+          struct foo *f = ihash_entry (ihash_cur (&i), struct foo, elem);
+          ...do something with f...
+        }
+
+   Modifying hash table H during iteration, using any of the
+   functions ihash_clear(), ihash_destroy(), ihash_insert(),
+   ihash_replace(), or ihash_delete(), invalidates all
+   iterators. */
+void
+ihash_first (struct ihash_iterator *i, struct ihash *h)
+{
+  ASSERT (i != NULL);
+  ASSERT (h != NULL);
+
+  i->hash = h;
+  i->bucket = 0;
+  i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order. */
+struct ihash_elem *
+ihash_next (struct ihash_iterator *i)
+{
+  struct ihash *h;
+
+  ASSERT (i != NULL);
+
+  h = i->hash;
+  if (i->elem != NULL)
+    i->elem = i->elem->next;
+  while (i->elem == NULL)
+    {
+      if (i->bucket >= h->old_bucket_cnt + h->bucket_cnt)
+        return NULL;
+      i->elem = *bucket_at (h, i->bucket++);
+    }
+  return i->elem;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling ihash_first() but before ihash_next(). */
+struct ihash_elem *
+ihash_cur (struct ihash_iterator *i)
+{
+  return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ihash_size (struct ihash *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ihash_empty (struct ihash *h)
+{
+  return h->elem_cnt == 0;
+}
+
+/* Returns bucket IDX of H, counting the old buckets, if any,
+   before the current ones. */
+static struct ihash_elem **
+bucket_at (struct ihash *h, size_t idx)
+{
+  if (idx < h->old_bucket_cnt)
+    return &h->old_buckets[idx];
+  return &h->buckets[idx - h->old_bucket_cnt];
+}
+
+/* Searches the chain starting at *LINK for an element equal to
+   E, whose hash value has been computed.  Returns the link that
+   points to it, or the null link at the end of the chain. */
+static struct ihash_elem **
+find_in_chain (struct ihash *h, struct ihash_elem **link,
+               struct ihash_elem *e)
+{
+  for (; *link != NULL; link = &(*link)->next)
+    if ((*link)->hash == e->hash
+        && !h->less (*link, e, h->aux) && !h->less (e, *link, h->aux))
+      break;
+  return link;
+}
+
+/* Computes E's hash value and returns the link in H that points
+   to an element equal to E.  If there is none, returns the null
+   link at the end of the chain in H's current buckets where E
+   belongs. */
+static struct ihash_elem **
+find_link (struct ihash *h, struct ihash_elem *e)
+{
+  e->hash = h->hash (e, h->aux);
+
+  /* Buckets that have already been moved are empty. */
+  if (h->old_buckets != NULL)
+    {
+      struct ihash_elem **link;
+
+      link = find_in_chain (h, &h->old_buckets[e->hash
+                                               & (h->old_bucket_cnt - 1)], e);
+      if (*link != NULL)
+        return link;
+    }
+  return find_in_chain (h, &h->buckets[e->hash & (h->bucket_cnt - 1)], e);
+}
+
+/* Inserts E, whose hash value has been computed, into H at
+   LINK, the null link at the end of a chain. */
+static void
+insert_elem (struct ihash *h, struct ihash_elem **link,
+             struct ihash_elem *e)
+{
+  e->next = NULL;
+  *link = e;
+  h->elem_cnt++;
+}
+
+/* Starts resizing H, if it has too many or too few elements for
+   its buckets and memory is available.  Otherwise, leaves it
+   alone; chains just get longer or stay sparse. */
+static void
+start_resize (struct ihash *h)
+{
+  struct ihash_elem **new_buckets;
+  size_t new_bucket_cnt;
+
+  if (h->elem_cnt > h->bucket_cnt * MAX_ELEMS_PER_BUCKET)
+    new_bucket_cnt = h->bucket_cnt * 2;
+  else if (h->bucket_cnt > MIN_BUCKETS
+           && h->elem_cnt * MIN_BUCKETS_PER_ELEM < h->bucket_cnt)
+    new_bucket_cnt = h->bucket_cnt / 2;
+  else
+    return;
+
+  new_buckets = calloc (new_bucket_cnt, sizeof *new_buckets);
+  if (new_buckets == NULL)
+    return;
+
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->move_idx = 0;
+  h->buckets = new_buckets;
+  h->bucket_cnt = new_bucket_cnt;
+}
+
+/* Does a step of resizing H: starts resizing if it is needed,
+   and moves the elements of a few old buckets to the current
+   ones if a resize is underway.  The old buckets are freed once
+   they are all empty. */
+static void
+resize_step (struct ihash *h)
+{
+  size_t i;
+
+  if (h->old_buckets == NULL)
+    start_resize (h);
+  if (h->old_buckets == NULL)
+    return;
+
+  for (i = 0; i < MOVE_BUCKETS && h->move_idx < h->old_bucket_cnt; i++)
+    {
+      struct ihash_elem *e = h->old_buckets[h->move_idx];
+
+      h->old_buckets[h->move_idx++] = NULL;
+      while (e != NULL)
+        {
+          struct ihash_elem *next = e->next;
+          struct ihash_elem **bucket = &h->buckets[e->hash
+                                                   & (h->bucket_cnt - 1)];
+
+          e->next = *bucket;
+          *bucket = e;
+          e = next;
+        }
+    }
+
+  if (h->move_idx == h->old_bucket_cnt)
+    {
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+      h->old_bucket_cnt = 0;
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef __LIB_KERNEL_IHASH_H
+#define __LIB_KERNEL_IHASH_H
+
+/* Incrementally resized hash table.
+
+   This has the same interface as the hash table in hash.h, and
+   is used the same way: each structure that can be in a table
+   embeds a struct ihash_elem, and ihash_entry() converts from a
+   struct ihash_elem back to the structure containing it.
+
+   It differs in how it is laid out and resized.  Each bucket is
+   a single pointer to a singly linked chain, and each element
+   caches its hash value, so a lookup only calls the comparison
+   function on elements whose hash values match, and a table of
+   buckets takes a quarter of the space.  When the table grows
+   or shrinks, the elements are not all moved at once: a new
+   bucket array is allocated, and each later insertion or
+   deletion moves a few buckets' worth of elements from the old
+   array into it.  Lookups consult both arrays until the move is
+   done.  Thus no single operation takes time proportional to
+   the number of elements, except for clearing and destroying
+   the table. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hash.h"               /* For the sample hash functions. */
+
+/* Hash element. */
+typedef struct ihash_elem
+  {
+    struct ihash_elem *next;    /* Next element in the same bucket. */
+    unsigned hash;              /* Hash value, while in a table. */
+  } ihash_elem_t;
+
+/* Converts pointer to hash element IHASH_ELEM into a pointer to
+   the structure that IHASH_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the hash element. */
+#define ihash_entry(IHASH_ELEM, STRUCT, MEMBER)                 \
+        ((STRUCT *) ((uint8_t *) &(IHASH_ELEM)->next            \
+                     - offsetof (STRUCT, MEMBER.next)))
+
+/* Computes and returns the hash value for hash element E, given
+   auxiliary data AUX. */
+typedef unsigned ihash_hash_func (const struct ihash_elem *e, void *aux);
+
+/* Compares the value of two hash elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool ihash_less_func (const struct ihash_elem *a,
+                              const struct ihash_elem *b,
+                              void *aux);
+
+/* Performs some operation on hash element E, given auxiliary
+   data AUX. */
+typedef void ihash_action_func (struct ihash_elem *e, void *aux);
+
+/* Hash table. */
+typedef struct ihash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t bucket_cnt;          /* Number of buckets, a power of 2. */
+    struct ihash_elem **buckets;        /* Array of `bucket_cnt' chains. */
+    size_t old_bucket_cnt;      /* Number of buckets in `old_buckets'. */
+    struct ihash_elem **old_buckets;    /* Buckets being moved into
+                                           `buckets', or null. */
+    size_t move_idx;            /* Next bucket of `old_buckets' to move. */
+    ihash_hash_func *hash;      /* Hash function. */
+    ihash_less_func *less;      /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `less'. */
+  } ihash_t;
+
+/* A hash table iterator. */
+typedef struct ihash_iterator
+  {
+    struct ihash *hash;         /* The hash table. */
+    size_t bucket;              /* Next bucket, counting old buckets
+                                   before current ones. */
+    struct ihash_elem *elem;    /* Current hash element. */
+  } ihash_iterator_t;
+
+/* Basic life cycle. */
+bool ihash_init (struct ihash *, ihash_hash_func *, ihash_less_func *,
+                 void *aux);
+void ihash_clear (struct ihash *, ihash_action_func *);
+void ihash_destroy (struct ihash *, ihash_action_func *);
+
+/* Search, insertion, deletion. */
+struct ihash_elem *ihash_insert (struct ihash *, struct ihash_elem *);
+struct ihash_elem *ihash_replace (struct ihash *, struct ihash_elem *);
+struct ihash_elem *ihash_find (struct ihash *, struct ihash_elem *);
+struct ihash_elem *ihash_delete (struct ihash *, struct ihash_elem *);
+
+/* Iteration. */
+void ihash_apply (struct ihash *, ihash_action_func *);
+void ihash_first (struct ihash_iterator *, struct ihash *);
+struct ihash_elem *ihash_next (struct ihash_iterator *);
+struct ihash_elem *ihash_cur (struct ihash_iterator *);
+
+/* Information. */
+size_t ihash_size (struct ihash *);
+bool ihash_empty (struct ihash *);
+
+#endif /* lib/kernel/ihash.h */
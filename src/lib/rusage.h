@@ -0,0 +1,24 @@
+/*! \file rusage.h
+ *
+ * Per-process resource accounting, shared by the kernel and user programs.
+ */
+
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+/*! Resources used by a process, as reported by the getrusage system call.
+    The kernel keeps one in each thread. */
+struct rusage {
+    unsigned long long user_ticks;      /*!< Timer ticks running user code. */
+    unsigned long long kernel_ticks;    /*!< Timer ticks running in the
+                                             kernel. */
+    unsigned long long page_faults;     /*!< Page faults resolved. */
+    unsigned long long swap_ins;        /*!< ...which read a page from swap. */
+    unsigned long long bytes_read;      /*!< Bytes returned by read. */
+    unsigned long long bytes_written;   /*!< Bytes accepted by write. */
+    unsigned long long voluntary_switches;  /*!< Times the process blocked. */
+    unsigned long long involuntary_switches; /*!< Times it was preempted, or
+                                                  yielded while runnable. */
+};
+
+#endif /* lib/rusage.h */
@@ -1,41 +1,107 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
 
 #pragma GCC diagnostic ignored "-Wnonnull-compare"
 
+/* The block functions below move and compare 32-bit words with the x86
+   string instructions, and only handle the few bytes at either end one at a
+   time.  They rely on the direction flag being clear, as the ABI requires on
+   function entry and intr_entry and _start ensure. */
+
+/*! A word which may be used to access memory of any type. */
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+/*! Blocks shorter than this are handled a byte at a time, because starting a
+    string instruction costs more than it saves. */
+#define SMALL_BLOCK 32
+
+/*! Returns the number of bytes from P to the next word boundary. */
+static inline size_t align_head(const void *p) {
+    return -(uintptr_t) p % sizeof(word_t);
+}
+
+/*! Copies SIZE bytes from SRC to DST, from the lowest address upward. This is
+    safe if the blocks do not overlap or DST is below SRC. */
+static inline void copy_up(void *dst_, const void *src_, size_t size) {
+    if (size < SMALL_BLOCK) {
+        unsigned char *dst = dst_;
+        const unsigned char *src = src_;
+        while (size-- > 0)
+            *dst++ = *src++;
+        return;
+    }
+
+    void *dst = dst_;
+    const void *src = src_;
+    size_t head = align_head(dst);
+    size_t words = (size - head) / sizeof(word_t);
+    size_t tail = (size - head) % sizeof(word_t);
+
+    /* Bytes up to DST's word boundary, then words, then the remaining
+       bytes. */
+    asm volatile ("rep movsb\n\t"
+                  "movl %3, %%ecx\n\t"
+                  "rep movsl\n\t"
+                  "movl %4, %%ecx\n\t"
+                  "rep movsb"
+                  : "+D" (dst), "+S" (src), "+c" (head)
+                  : "r" (words), "r" (tail)
+                  : "memory");
+}
+
+/*! Copies SIZE bytes from SRC to DST, from the highest address downward. This
+    is safe if DST is above SRC, even if the blocks overlap. */
+static inline void copy_down(void *dst, const void *src, size_t size) {
+    unsigned char *d = (unsigned char *) dst + size - 1;
+    const unsigned char *s = (const unsigned char *) src + size - 1;
+
+    if (size < SMALL_BLOCK) {
+        while (size-- > 0)
+            *d-- = *s--;
+        return;
+    }
+
+    size_t words = size / sizeof(word_t);
+    size_t tail = size % sizeof(word_t);
+
+    /* The trailing bytes, then words.  The direction flag must be set and
+       cleared within a single statement, so that the compiler never runs
+       code of its own while it is set. */
+    asm volatile ("std\n\t"
+                  "rep movsb\n\t"
+                  "subl $3, %%esi\n\t"
+                  "subl $3, %%edi\n\t"
+                  "movl %3, %%ecx\n\t"
+                  "rep movsl\n\t"
+                  "cld"
+                  : "+D" (d), "+S" (s), "+c" (tail)
+                  : "r" (words)
+                  : "cc", "memory");
+}
+
 /*! Copies SIZE bytes from SRC to DST, which must not overlap.
     Returns DST. */
-void * memcpy(void *dst_, const void *src_, size_t size) {
-    unsigned char *dst = dst_;
-    const unsigned char *src = src_;
-
+void * memcpy(void *dst, const void *src, size_t size) {
     ASSERT(dst != NULL || size == 0);
     ASSERT(src != NULL || size == 0);
 
-    while (size-- > 0)
-        *dst++ = *src++;
-
-    return dst_;
+    copy_up(dst, src, size);
+    return dst;
 }
 
 /*! Copies SIZE bytes from SRC to DST, which are allowed to
     overlap.  Returns DST. */
-void * memmove(void *dst_, const void *src_, size_t size) {
-    unsigned char *dst = dst_;
-    const unsigned char *src = src_;
-
+void * memmove(void *dst, const void *src, size_t size) {
     ASSERT(dst != NULL || size == 0);
     ASSERT(src != NULL || size == 0);
 
-    if (dst < src) {
-        while (size-- > 0)
-            *dst++ = *src++;
+    if ((uintptr_t) dst - (uintptr_t) src >= size) {
+        /* DST is below SRC, or above the end of it. */
+        copy_up(dst, src, size);
     }
-    else {
-        dst += size;
-        src += size;
-        while (size-- > 0)
-            *--dst = *--src;
+    else if (dst != src) {
+        copy_down(dst, src, size);
     }
 
     return dst;
@@ -52,6 +118,21 @@ int memcmp(const void *a_, const void *b_, size_t size) {
     ASSERT(a != NULL || size == 0);
     ASSERT(b != NULL || size == 0);
 
+    size_t words = size / sizeof(word_t);
+    if (words > 0) {
+        /* Skip the leading equal words.  REPE CMPSL stops just after the
+           first differing word, or after the last word, so back up and
+           compare that word, and anything after it, a byte at a time. */
+        size_t left = words;
+        asm ("repe cmpsl"
+             : "+S" (a), "+D" (b), "+c" (left)
+             :
+             : "cc", "memory");
+        a -= sizeof(word_t);
+        b -= sizeof(word_t);
+        size -= (words - left - 1) * sizeof(word_t);
+    }
+
     for (; size-- > 0; a++, b++) {
         if (*a != *b)
             return *a > *b ? +1 : -1;
@@ -289,12 +370,31 @@ char * strtok_r(char *s, const char *delimiters, char **save_ptr) {
 
 /*! Sets the SIZE bytes in DST to VALUE. */
 void * memset(void *dst_, int value, size_t size) {
-    unsigned char *dst = dst_;
+    void *dst = dst_;
+    word_t pattern = (unsigned char) value * 0x01010101u;
 
     ASSERT(dst != NULL || size == 0);
 
-    while (size-- > 0)
-        *dst++ = value;
+    if (size < SMALL_BLOCK) {
+        unsigned char *p = dst_;
+        while (size-- > 0)
+            *p++ = value;
+        return dst_;
+    }
+
+    size_t head = align_head(dst);
+    size_t words = (size - head) / sizeof(word_t);
+    size_t tail = (size - head) % sizeof(word_t);
+
+    /* As in copy_up(). STOSB stores the low byte of PATTERN. */
+    asm volatile ("rep stosb\n\t"
+                  "movl %3, %%ecx\n\t"
+                  "rep stosl\n\t"
+                  "movl %4, %%ecx\n\t"
+                  "rep stosb"
+                  : "+D" (dst), "+c" (head)
+                  : "a" (pattern), "r" (words), "r" (tail)
+                  : "memory");
 
     return dst_;
 }
@@ -305,8 +405,22 @@ size_t strlen(const char *string) {
 
     ASSERT(string != NULL);
 
-    for (p = string; *p != '\0'; p++)
-        continue;
+    /* Go a byte at a time until P is aligned, and then a word at a time.
+       Aligned words never cross a page boundary, so reading past the null
+       terminator within one cannot fault. */
+    for (p = string; (uintptr_t) p % sizeof(word_t) != 0; p++) {
+        if (*p == '\0')
+            return p - string;
+    }
+    for (;; p += sizeof(word_t)) {
+        word_t w = *(const word_t *) p;
+
+        /* Nonzero if and only if some byte of W is zero. */
+        if (((w - 0x01010101u) & ~w & 0x80808080u) != 0)
+            break;
+    }
+    while (*p != '\0')
+        p++;
 
     return p - string;
 }
@@ -34,7 +34,23 @@ enum {
     SYS_MKDIR,                  /*!< Create a directory. */
     SYS_READDIR,                /*!< Reads a directory entry. */
     SYS_ISDIR,                  /*!< Tests if a fd represents a directory. */
-    SYS_INUMBER                 /*!< Returns the inode number for a fd. */
+    SYS_INUMBER,                /*!< Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_STATS,                  /*!< Reads kernel statistics. */
+    SYS_TUNE,                   /*!< Sets a tunable. */
+    SYS_GETTIME,                /*!< Reads the time since boot. */
+    SYS_GETRUSAGE               /*!< Reads the process's resource usage. */
+};
+
+/*! Kinds of statistics read by SYS_STATS. */
+enum {
+    STATS_LOCKS,                /*!< Lock contention, if profiled. */
+    STATS_SYSCALLS,             /*!< The calling process's system calls. */
+    STATS_TRACE,                /*!< Latest traced kernel events. */
+    STATS_BLOCK,                /*!< Block device requests. */
+    STATS_IDE,                  /*!< IDE channel lock use. */
+    STATS_TUNABLES              /*!< Tunables and their values. */
 };
 
 #endif /* lib/syscall-nr.h */
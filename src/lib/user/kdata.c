@@ -0,0 +1,22 @@
+#include <kdata.h>
+#include <syscall.h>
+
+/*! Copies a consistent snapshot of the kernel data page into KD, without
+    trapping into the kernel. Retries while the kernel is updating it. */
+void kdata_read(struct kdata *kd) {
+    const volatile struct kdata *page =
+        (const volatile struct kdata *) KDATA_ADDR;
+    unsigned seq;
+
+    do {
+        while ((seq = page->seq) & 1)
+            continue;
+        asm volatile ("" : : : "memory");
+        kd->seq = seq;
+        kd->ticks_per_sec = page->ticks_per_sec;
+        kd->ticks = page->ticks;
+        kd->load_avg = page->load_avg;
+        kd->boot_time = page->boot_time;
+        asm volatile ("" : : : "memory");
+    } while (page->seq != seq);
+}
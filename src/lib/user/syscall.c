@@ -6,14 +6,18 @@
  * call being invoked.  The remaining functions are wrappers for standard
  * UNIX operations, which simply use the syscall macros to invoke the
  * system call.
+ *
+ * On processors which support it, system calls are made with SYSENTER,
+ * passing the number and arguments in registers, which is much cheaper than
+ * the `int $0x30' trap used otherwise.
  */
 
 #include <syscall.h>
 #include "../syscall-nr.h"
 
-/*! Invokes syscall NUMBER, passing no arguments, and returns the
-    return value as an `int'. */
-#define syscall0(NUMBER)                                        \
+/*! Invokes syscall NUMBER with `int $0x30', passing no arguments, and
+    returns the return value as an `int'. */
+#define int_syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
@@ -24,9 +28,9 @@
           retval;                                               \
         })
 
-/*! Invokes syscall NUMBER, passing argument ARG0, and returns the
-    return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
+/*! Invokes syscall NUMBER with `int $0x30', passing argument ARG0, and
+    returns the return value as an `int'. */
+#define int_syscall1(NUMBER, ARG0)                                           \
         ({                                                               \
           int retval;                                                    \
           asm volatile                                                   \
@@ -38,9 +42,9 @@
           retval;                                                        \
         })
 
-/*! Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
-    returns the return value as an `int'. */
-#define syscall2(NUMBER, ARG0, ARG1)                            \
+/*! Invokes syscall NUMBER with `int $0x30', passing arguments ARG0 and
+    ARG1, and returns the return value as an `int'. */
+#define int_syscall2(NUMBER, ARG0, ARG1)                            \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
@@ -54,9 +58,9 @@
           retval;                                               \
         })
 
-/*! Invokes syscall NUMBER, passing arguments ARG0, ARG1, and
-    ARG2, and returns the return value as an `int'. */
-#define syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
+/*! Invokes syscall NUMBER with `int $0x30', passing arguments ARG0, ARG1,
+    and ARG2, and returns the return value as an `int'. */
+#define int_syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
@@ -71,6 +75,55 @@
           retval;                                               \
         })
 
+/*! Whether the processor supports SYSENTER: 1 if so, 0 if not, or -1 if
+    not yet tested. */
+static int have_sysenter = -1;
+
+/*! Returns true if system calls may be made with SYSENTER. */
+static inline bool use_sysenter(void) {
+    if (have_sysenter < 0) {
+        unsigned eax = 1, ebx, ecx, edx;
+        asm volatile ("cpuid"
+                      : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+        have_sysenter = (edx & (1 << 11)) != 0;
+    }
+    return have_sysenter;
+}
+
+/*! Invokes syscall NUMBER with SYSENTER, passing ARG0, ARG1 and ARG2 in
+    %ebx, %esi and %edi, and returns the return value. The kernel returns
+    to the stack pointer in %ecx and the address in %edx. */
+static inline int fast_syscall(int number, unsigned arg0, unsigned arg1,
+                               unsigned arg2) {
+    int retval;
+    asm volatile ("movl %%esp, %%ecx; movl $1f, %%edx; sysenter; 1:"
+                  : "=a" (retval)
+                  : "a" (number), "b" (arg0), "S" (arg1), "D" (arg2)
+                  : "ecx", "edx", "cc", "memory");
+    return retval;
+}
+
+/*! Invoke syscall NUMBER with SYSENTER if possible, or `int $0x30'
+    otherwise, passing the given arguments. @{ */
+#define syscall0(NUMBER)                                        \
+        (use_sysenter() ? fast_syscall(NUMBER, 0, 0, 0)         \
+                        : int_syscall0(NUMBER))
+#define syscall1(NUMBER, ARG0)                                  \
+        (use_sysenter()                                         \
+         ? fast_syscall(NUMBER, (unsigned) (ARG0), 0, 0)        \
+         : int_syscall1(NUMBER, ARG0))
+#define syscall2(NUMBER, ARG0, ARG1)                            \
+        (use_sysenter()                                         \
+         ? fast_syscall(NUMBER, (unsigned) (ARG0),              \
+                        (unsigned) (ARG1), 0)                   \
+         : int_syscall2(NUMBER, ARG0, ARG1))
+#define syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
+        (use_sysenter()                                         \
+         ? fast_syscall(NUMBER, (unsigned) (ARG0),              \
+                        (unsigned) (ARG1), (unsigned) (ARG2))   \
+         : int_syscall3(NUMBER, ARG0, ARG1, ARG2))
+/*! @} */
+
 void halt(void) {
     syscall0(SYS_HALT);
     NOT_REACHED();
@@ -153,3 +206,19 @@ int inumber(int fd) {
     return syscall1(SYS_INUMBER, fd);
 }
 
+int stats(int kind, char *buffer, unsigned size) {
+    return syscall3(SYS_STATS, kind, buffer, size);
+}
+
+bool tune(const char *setting) {
+    return syscall1(SYS_TUNE, setting);
+}
+
+int gettime(void) {
+    return syscall0(SYS_GETTIME);
+}
+
+bool getrusage(struct rusage *usage) {
+    return syscall1(SYS_GETRUSAGE, usage);
+}
+
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <kdata.h>
+#include <rusage.h>
 
 /*! Process identifier. */
 typedef int pid_t;
@@ -45,5 +47,14 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* Extensions. */
+int stats(int kind, char *buffer, unsigned size);
+bool tune(const char *setting);
+int gettime(void);
+bool getrusage(struct rusage *usage);
+
+/* Kernel data page, read without a system call. */
+void kdata_read(struct kdata *kd);
+
 #endif /* lib/user/syscall.h */
 
@@ -19,17 +19,22 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/profile.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/trace.h"
 #include "threads/thread.h"
+#include "threads/tune.h"
 
 #ifdef USERPROG
 
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/kdata.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "vm/frametbl.h"
 
 #else
 
@@ -39,7 +44,9 @@
 
 #ifdef VM
 
+#include "vm/mappings.h"
 #include "vm/swaptbl.h"
+#include "vm/swapcache.h"
 
 #endif
 
@@ -110,6 +117,8 @@ int main(void) {
     palloc_init(user_page_limit);
     malloc_init();
     paging_init();
+    profile_init();
+    trace_init();
 
     /* Segmentation. */
 #ifdef USERPROG
@@ -125,12 +134,17 @@ int main(void) {
 #ifdef USERPROG
     exception_init();
     syscall_init();
+    kdata_init();
 #endif
 
     /* Start thread scheduler and enable interrupts. */
     thread_start();
+    timer_start();
     serial_init_queue();
     timer_calibrate();
+#ifdef USERPROG
+    frametbl_start_aging();
+#endif
 
 #ifdef FILESYS
     /* Initialize file system. */
@@ -141,6 +155,7 @@ int main(void) {
 
 #ifdef VM
     swaptbl_init();
+    vm_init();
 #endif
 
     printf("Boot complete.\n");
@@ -188,7 +203,9 @@ static void paging_init(void) {
             pd[pde_idx] = pde_create(pt);
         }
 
-        pt[pte_idx] = pte_create_kernel(vaddr, !in_kernel_text);
+        /* Kernel mappings are the same in every page directory, so
+           they are made global to survive page directory switches. */
+        pt[pte_idx] = pte_create_kernel(vaddr, !in_kernel_text) | PTE_G;
     }
 
     /* Store the physical address of the page directory into CR3
@@ -197,6 +214,16 @@ static void paging_init(void) {
        to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
        of the Page Directory". */
     asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+    /* Enable global pages, if the CPU has them (CPUID.01H:EDX bit 13).
+       See [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+    if (edx & (1 << 13)) {
+        uint32_t cr4;
+        asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+        asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE) : "memory");
+    }
 }
 
 /*! Breaks the kernel command line into words and returns them as
@@ -255,15 +282,36 @@ static char ** parse_options(char **argv) {
 #ifdef VM
         else if (!strcmp(name, "-swap"))
             swap_bdev_name = value;
+        else if (!strcmp(name, "-swapcache"))
+            swapcache_pages = atoi(value);
 #endif
 #endif
         else if (!strcmp(name, "-rs"))
             random_init(atoi(value));
         else if (!strcmp(name, "-mlfqs"))
             thread_mlfqs = true;
+        else if (!strcmp(name, "-tickless"))
+            timer_tickless = true;
+        else if (!strcmp(name, "-profile"))
+            profile_enabled = true;
+        else if (!strcmp(name, "-trace"))
+            trace_enabled = true;
+        else if (!strcmp(name, "-tune")) {
+            if (value == NULL || !tune_set(value, true))
+                PANIC("bad tunable setting `%s' (use -h for help)",
+                      value != NULL ? value : "");
+        }
 #ifdef USERPROG
         else if (!strcmp(name, "-ul"))
             user_page_limit = atoi(value);
+        else if (!strcmp(name, "-scstats"))
+            syscall_stats_enabled = true;
+        else if (!strcmp(name, "-age-blocks"))
+            frametbl_age_blocks = atoi(value);
+        else if (!strcmp(name, "-age-freq"))
+            frametbl_age_freq = atoi(value);
+        else if (!strcmp(name, "-age-budget"))
+            frametbl_age_budget = atoi(value);
 #endif
         else
             PANIC("unknown option `%s' (use -h for help)", name);
@@ -374,14 +422,25 @@ static void usage(void) {
            "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
            "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+           "  -swapcache=PAGES   Keep up to PAGES of compressed swap in RAM.\n"
 #endif
 #endif
            "  -rs=SEED           Set random number seed to SEED.\n"
            "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+           "  -tickless          Program the timer for each event, not each tick.\n"
+           "  -profile           Sample the running code on each timer tick.\n"
+           "  -trace             Record kernel events and print them at shutdown.\n"
+           "  -tune=NAME=VALUE   Set tunable NAME to VALUE (see below).\n"
 #ifdef USERPROG
            "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+           "  -scstats           Print system call statistics on exit.\n"
+           "  -age-blocks=N      Age 1/N of the frame table per aging pass.\n"
+           "  -age-freq=N        Run an aging pass every N user ticks.\n"
+           "  -age-budget=N      Age at most N frames per aging pass.\n"
 #endif
+           "\nTunables:\n"
           );
+    tune_print();
     shutdown_power_off();
 }
 
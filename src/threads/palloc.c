@@ -10,12 +10,20 @@
 
    By default, half of system RAM is given to the kernel pool and half to the
    user pool.  That should be huge overkill for the kernel pool, but that's
-   just fine for demonstration purposes. */
+   just fine for demonstration purposes.
+
+   The kernel pool is managed by a buddy allocator: free memory is kept as
+   blocks of 2**ORDER pages, aligned to their size, on one free list per
+   order.  An allocation takes a block of the smallest sufficient order,
+   splitting a larger one if needed, and a freed block is merged with its
+   buddy (the other half of the block of the next order) whenever the buddy
+   is free too.  Both take O(log n) time.  The user pool is managed by the
+   frame table. */
 
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -26,20 +34,37 @@
 #include "threads/vaddr.h"
 #include "vm/frametbl.h"
 
+/*! Order of the largest block of the kernel pool: 2**MAX_ORDER pages. */
+#define MAX_ORDER 10
+
 /*! A memory pool. */
 typedef struct pool {
     bool is_kernel;            /*!< True for kernel pool, false otherwise. */
     lock_t lock;               /*!< Mutual exclusion. */
-    void *used_map;            /*!< Acquires free pages (bitmap or frametbl). */
+    void *used_map;            /*!< Acquires free pages (buddy orders or
+                                    frametbl). */
     uint8_t *base;             /*!< Base of pool. */
+    size_t page_cnt;           /*!< Number of pages in the pool. */
+    list_t free_lists[MAX_ORDER + 1];   /*!< Free blocks of each order, for
+                                             the kernel pool. The list
+                                             elements are kept in the free
+                                             pages themselves. */
 } pool_t;
 
 /*! Two pools: one for kernel data, one for user pages. */
 static pool_t kernel_pool, user_pool;
 
+/*! Statistics of the kernel pool, per order. @{ */
+static unsigned long long alloc_cnt[MAX_ORDER + 1];  /*!< Blocks allocated. */
+static unsigned long long split_cnt[MAX_ORDER + 1];  /*!< Blocks split. */
+static unsigned long long merge_cnt[MAX_ORDER + 1];  /*!< Buddies merged. */
+/*! @} */
+
 static void init_pool(pool_t *, void *base, size_t page_cnt,
                       bool is_kernel, const char *name);
 static bool page_from_pool(const pool_t *, void *page);
+static size_t buddy_alloc(pool_t *, size_t page_cnt);
+static void buddy_free(pool_t *, size_t page_idx, size_t page_cnt);
 
 /*! Initializes the page allocator.  At most USER_PAGE_LIMIT
     pages are put into the user pool. */
@@ -67,7 +92,8 @@ void palloc_init(size_t user_page_limit) {
     otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
     then the pages are filled with zeros.  If too few pages are
     available, returns a null pointer, unless PAL_ASSERT is set in
-    FLAGS, in which case the kernel panics. */
+    FLAGS, in which case the kernel panics.  If PAL_NOEVICT is set,
+    a user page is only returned if one is free without evicting. */
 void * palloc_get_multiple(palloc_flags_t flags, size_t page_cnt) {
     if (page_cnt == 0) {
         return NULL;
@@ -77,14 +103,14 @@ void * palloc_get_multiple(palloc_flags_t flags, size_t page_cnt) {
 
     if (pool->is_kernel) {
         lock_acquire(&pool->lock);
-        size_t page_idx = bitmap_scan_and_flip((bitmap_t *)pool->used_map, 0,
-            page_cnt, false);
+        size_t page_idx = buddy_alloc(pool, page_cnt);
         lock_release(&pool->lock);
-        pages = page_idx == BITMAP_ERROR ? NULL :
+        pages = page_idx == SIZE_MAX ? NULL :
             pool->base + PGSIZE * page_idx;
     } else {
         ASSERT(page_cnt == 1); // User-space frames don't have to be consecutive
-        pages = frametbl_get_frame();
+        pages = flags & PAL_NOEVICT ? frametbl_try_get_frame() :
+            frametbl_get_frame();
     }
 
     if (pages != NULL) {
@@ -128,8 +154,7 @@ void palloc_free_multiple(void *pages, size_t page_cnt) {
         size_t page_idx = pg_no(pages) - pg_no(pool->base);
 
         lock_acquire(&pool->lock);
-        ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
-        bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+        buddy_free(pool, page_idx, page_cnt);
         lock_release(&pool->lock);
     } else {
         ASSERT(page_cnt == 1); // User-space frames don't have to be consecutive
@@ -150,8 +175,7 @@ static void init_pool(pool_t *p, void *base, size_t page_cnt,
     /* We'll put the pool's used_map at its base.
        Calculate the space needed for the map
        and subtract it from the pool's size. */
-    size_t buf_size = is_kernel ? bitmap_buf_size(page_cnt) :
-        frametbl_buf_size(page_cnt);
+    size_t buf_size = is_kernel ? page_cnt : frametbl_buf_size(page_cnt);
     size_t map_pages = DIV_ROUND_UP(buf_size, PGSIZE);
     if (map_pages > page_cnt) {
         PANIC("Not enough memory in %s for used map.", name);
@@ -162,21 +186,141 @@ static void init_pool(pool_t *p, void *base, size_t page_cnt,
 
     /* Initialize the pool. */
     lock_init(&p->lock);
-    p->used_map = is_kernel ?
-        (void *) bitmap_create_in_buf(page_cnt, base, map_pages * PGSIZE) :
-        (void *) frametbl_create_in_buf(page_cnt, base, map_pages * PGSIZE);
+    lock_set_name(&p->lock, name);
     p->base = base + map_pages * PGSIZE;
+    p->page_cnt = page_cnt;
     p->is_kernel = is_kernel;
+    if (is_kernel) {
+        p->used_map = base;
+        memset(p->used_map, 0, page_cnt);
+        for (int order = 0; order <= MAX_ORDER; order++) {
+            list_init(&p->free_lists[order]);
+        }
+        buddy_free(p, 0, page_cnt);
+    } else {
+        p->used_map = frametbl_create_in_buf(page_cnt, base,
+                                             map_pages * PGSIZE);
+    }
 }
 
 /*! Returns true if PAGE was allocated from POOL, false otherwise. */
 static bool page_from_pool(const pool_t *pool, void *page) {
     size_t page_no = pg_no(page);
     size_t start_page = pg_no(pool->base);
-    size_t size = pool->is_kernel ? bitmap_size((bitmap_t *)(pool->used_map)) :
-        frame_tbl->num_frames;
-    size_t end_page = start_page + size;
+    size_t end_page = start_page + pool->page_cnt;
 
     return page_no >= start_page && page_no < end_page;
 }
 
+/*! Returns the free order map of kernel pool POOL. Each page which starts a
+    free block holds the block's order plus one, and every other page 0. */
+static uint8_t *free_orders(pool_t *pool) {
+    return pool->used_map;
+}
+
+/*! Returns the free list element stored in page PAGE_IDX of POOL. */
+static list_elem_t *block_elem(pool_t *pool, size_t page_idx) {
+    return (list_elem_t *) (pool->base + page_idx * PGSIZE);
+}
+
+/*! Returns the index of the page holding free list element E of POOL. */
+static size_t block_idx(pool_t *pool, list_elem_t *e) {
+    return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/*! Puts the free block of order ORDER at PAGE_IDX on its free list. */
+static void push_block(pool_t *pool, size_t page_idx, int order) {
+    free_orders(pool)[page_idx] = order + 1;
+    list_push_front(&pool->free_lists[order], block_elem(pool, page_idx));
+}
+
+/*! Takes the free block at PAGE_IDX off its free list. */
+static void remove_block(pool_t *pool, size_t page_idx) {
+    free_orders(pool)[page_idx] = 0;
+    list_remove(block_elem(pool, page_idx));
+}
+
+/*! Frees the block of order ORDER at PAGE_IDX, merging it with its buddy as
+    long as the buddy is free. */
+static void free_block(pool_t *pool, size_t page_idx, int order) {
+    while (order < MAX_ORDER) {
+        size_t buddy = page_idx ^ ((size_t) 1 << order);
+        if (buddy + ((size_t) 1 << order) > pool->page_cnt
+            || free_orders(pool)[buddy] != order + 1) {
+            break;
+        }
+        remove_block(pool, buddy);
+        merge_cnt[order]++;
+        page_idx &= ~((size_t) 1 << order);
+        order++;
+    }
+    push_block(pool, page_idx, order);
+}
+
+/*! Frees the PAGE_CNT pages of POOL starting at PAGE_IDX, as the largest
+    aligned blocks they can be divided into. */
+static void buddy_free(pool_t *pool, size_t page_idx, size_t page_cnt) {
+    ASSERT(page_idx + page_cnt <= pool->page_cnt);
+    while (page_cnt > 0) {
+        int order = MAX_ORDER;
+        while (page_idx % ((size_t) 1 << order) != 0
+               || ((size_t) 1 << order) > page_cnt) {
+            order--;
+        }
+        ASSERT(free_orders(pool)[page_idx] == 0);
+        free_block(pool, page_idx, order);
+        page_idx += (size_t) 1 << order;
+        page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/*! Allocates PAGE_CNT contiguous pages from POOL and returns the index of
+    the first, or SIZE_MAX if there is no large enough block. The block
+    is rounded up to a power of two to be found, but the pages past PAGE_CNT
+    are given back right away. */
+static size_t buddy_alloc(pool_t *pool, size_t page_cnt) {
+    int order = 0;
+    while (((size_t) 1 << order) < page_cnt) {
+        if (++order > MAX_ORDER) return SIZE_MAX;
+    }
+
+    int found = order;
+    while (list_empty(&pool->free_lists[found])) {
+        if (++found > MAX_ORDER) return SIZE_MAX;
+    }
+    size_t page_idx = block_idx(pool, list_front(&pool->free_lists[found]));
+    remove_block(pool, page_idx);
+
+    // split off the upper halves until the block is the right size
+    while (found > order) {
+        split_cnt[found]++;
+        found--;
+        push_block(pool, page_idx + ((size_t) 1 << found), found);
+    }
+    alloc_cnt[order]++;
+
+    size_t block_cnt = (size_t) 1 << order;
+    if (block_cnt > page_cnt) {
+        buddy_free(pool, page_idx + page_cnt, block_cnt - page_cnt);
+    }
+    return page_idx;
+}
+
+/*! Prints statistics about the kernel pool's buddy allocator. */
+void palloc_print_stats(void) {
+    pool_t *pool = &kernel_pool;
+    printf("Kernel pool: %zu pages\n", pool->page_cnt);
+    lock_acquire(&pool->lock);
+    for (int order = 0; order <= MAX_ORDER; order++) {
+        size_t free_cnt = list_size(&pool->free_lists[order]);
+        if (free_cnt == 0 && alloc_cnt[order] == 0 && split_cnt[order] == 0
+            && merge_cnt[order] == 0) {
+            continue;
+        }
+        printf("  order %2d: %zu free, %llu allocs, %llu splits, %llu merges\n",
+               order, free_cnt, alloc_cnt[order], split_cnt[order],
+               merge_cnt[order]);
+    }
+    lock_release(&pool->lock);
+}
+
@@ -8,7 +8,8 @@ typedef enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_NOEVICT = 010           /* Fail rather than evict a user page. */
   } palloc_flags_t;
 
 void palloc_init (size_t user_page_limit);
@@ -16,5 +17,6 @@ void *palloc_get_page (palloc_flags_t);
 void *palloc_get_multiple (palloc_flags_t, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,142 @@
+/*! \file profile.c
+ *
+ * Sampling CPU profiler. On each timer tick, the address of the instruction
+ * the timer interrupted and the running thread's tid are stored in a ring
+ * buffer, which keeps the latest PROFILE_SAMPLES samples. At shutdown the
+ * samples are printed, counted by address, on "Profile samples:" lines,
+ * which `backtrace --profile' turns into a flat profile by function.
+ * Addresses below PHYS_BASE are in user programs, and are symbolized by
+ * giving backtrace the user program's binary.
+ */
+
+#include "threads/profile.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/*! Pages of samples. */
+#define PROFILE_PAGES 16
+
+/*! Number of samples kept. */
+#define PROFILE_SAMPLES (PROFILE_PAGES * PGSIZE / sizeof(sample_t))
+
+/*! Addresses printed per line. */
+#define ADDRS_PER_LINE 6
+
+/*! Most threads counted separately in the summary. */
+#define MAX_THREADS 16
+
+/*! A sample. */
+typedef struct sample {
+    uintptr_t eip;          /*!< Interrupted instruction. */
+    tid_t tid;              /*!< Running thread. */
+} sample_t;
+
+bool profile_enabled;
+
+/*! Ring buffer of samples, and the number of samples taken. The latest
+    sample is at index (sample_cnt - 1) % PROFILE_SAMPLES. */
+static sample_t *samples;
+static unsigned long long sample_cnt;
+
+/*! Number of samples taken in user programs. */
+static unsigned long long user_cnt;
+
+/*! Allocates the sample buffer, if profiling is enabled. Must be called
+    after palloc_init(). */
+void profile_init(void) {
+    if (!profile_enabled)
+        return;
+    samples = palloc_get_multiple(0, PROFILE_PAGES);
+    if (samples == NULL)
+        printf("profile: no memory for samples, profiling disabled\n");
+}
+
+/*! Records a sample of the code interrupted by timer interrupt frame F, if
+    profiling. Called by the timer interrupt on each tick. */
+void profile_sample(const intr_frame_t *f) {
+    if (samples == NULL)
+        return;
+
+    sample_t *s = &samples[sample_cnt++ % PROFILE_SAMPLES];
+    s->eip = (uintptr_t) f->eip;
+    s->tid = thread_current()->tid;
+    if (is_user_vaddr((void *) s->eip))
+        user_cnt++;
+}
+
+/*! Orders samples by address. */
+static int sample_cmp(const void *a_, const void *b_) {
+    const sample_t *a = a_;
+    const sample_t *b = b_;
+    return a->eip < b->eip ? -1 : a->eip > b->eip;
+}
+
+/*! Prints how many of the N samples at S each thread took. */
+static void print_threads(const sample_t *s, size_t n) {
+    tid_t tids[MAX_THREADS];
+    size_t counts[MAX_THREADS];
+    size_t thread_cnt = 0;
+    size_t other_cnt = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t t;
+        for (t = 0; t < thread_cnt && tids[t] != s[i].tid; t++)
+            continue;
+        if (t == thread_cnt) {
+            if (thread_cnt == MAX_THREADS) {
+                other_cnt++;
+                continue;
+            }
+            tids[thread_cnt] = s[i].tid;
+            counts[thread_cnt++] = 0;
+        }
+        counts[t]++;
+    }
+
+    printf("Profile threads:");
+    for (size_t t = 0; t < thread_cnt; t++)
+        printf(" %d:%zu", tids[t], counts[t]);
+    if (other_cnt > 0)
+        printf(" other:%zu", other_cnt);
+    printf("\n");
+}
+
+/*! Prints the samples, counted by address. Sorts the sample buffer, so no
+    more samples are taken afterward. */
+void profile_print_stats(void) {
+    if (samples == NULL)
+        return;
+
+    size_t n = sample_cnt < PROFILE_SAMPLES ? sample_cnt : PROFILE_SAMPLES;
+    sample_t *s = samples;
+
+    /* Stop sampling. */
+    samples = NULL;
+
+    printf("Profile: %llu samples, %llu in user programs, %llu overwritten\n",
+           sample_cnt, user_cnt, sample_cnt - n);
+    print_threads(s, n);
+
+    qsort(s, n, sizeof *s, sample_cmp);
+    size_t col = 0;
+    for (size_t i = 0; i < n; ) {
+        size_t j = i;
+        while (j < n && s[j].eip == s[i].eip)
+            j++;
+        if (col == 0)
+            printf("Profile samples:");
+        printf(" %#"PRIxPTR"*%zu", s[i].eip, j - i);
+        if (++col == ADDRS_PER_LINE) {
+            printf("\n");
+            col = 0;
+        }
+        i = j;
+    }
+    if (col != 0)
+        printf("\n");
+}
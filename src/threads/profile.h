@@ -0,0 +1,19 @@
+/*! \file profile.h
+ *
+ * Sampling CPU profiler.
+ */
+
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+/*! Whether to profile, set by the -profile command-line option. */
+extern bool profile_enabled;
+
+void profile_init(void);
+void profile_sample(const intr_frame_t *);
+void profile_print_stats(void);
+
+#endif /* threads/profile.h */
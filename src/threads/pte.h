@@ -75,8 +75,13 @@ static inline uintptr_t pd_no(const void *va) {
 #define PTE_U 0x4               /*!< 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /*!< 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /*!< 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_G 0x100             /*!< 1=global, kept in the TLB when CR3 is
+                                     loaded (PTEs only, needs CR4_PGE). */
 /*! @} */
 
+/*! Page Global Enable flag in control register 4. */
+#define CR4_PGE 0x80
+
 #define _AVL1 0x200
 #define _AVL2 0x400
 #define _AVL3 0x800
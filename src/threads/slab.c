@@ -0,0 +1,261 @@
+/*! \file slab.c
+
+   Object caches.
+
+   A cache hands out objects of a single size.  Objects are carved out of
+   "slabs", pages obtained from the page allocator, with no rounding beyond
+   word alignment, so unlike malloc() no space is lost to size classes.  Each
+   slab keeps a list of its free objects, and the cache keeps the slabs which
+   have free objects on a list.
+
+   If the cache has a constructor, it is run once on each object when its
+   slab is created, and objects must be freed back into that constructed
+   state, so that things like embedded locks need not be set up on every
+   allocation.  The free list link of such objects is kept after the object
+   rather than in it.
+
+   In front of the slabs, each cache keeps a magazine: a small stack of
+   recently freed objects.  Allocations and frees are served from the
+   magazine with interrupts briefly disabled and without taking the cache's
+   lock; only when it runs empty or full are objects moved in bulk between
+   it and the slabs.  Caches must not be used from interrupt context. */
+
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/*! Maximum number of caches. */
+#define MAX_CACHES 16
+
+/*! Number of objects a magazine holds. */
+#define MAGAZINE_SIZE 16
+
+/*! Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/*! A cache of objects of one type. */
+struct kmem_cache {
+    const char *name;           /*!< Name, for statistics. */
+    size_t obj_size;            /*!< Size of each object in bytes. */
+    size_t slot_size;           /*!< Space taken by each object in a slab. */
+    size_t link_ofs;            /*!< Offset of a free object's link. */
+    size_t objs_per_slab;       /*!< Number of objects in a slab. */
+    kmem_ctor_func *ctor;       /*!< Constructor, or null. */
+    lock_t lock;                /*!< Protects the slabs. */
+    list_t slabs;               /*!< Slabs with free objects. */
+    size_t empty_cnt;           /*!< Slabs on the list with no objects in
+                                     use. */
+    void *magazine[MAGAZINE_SIZE];  /*!< Recently freed objects. */
+    size_t magazine_cnt;        /*!< Number of objects in the magazine.
+                                     The magazine is protected by disabling
+                                     interrupts. */
+
+    /* Statistics. */
+    unsigned long long alloc_cnt;       /*!< Objects allocated. */
+    unsigned long long magazine_hits;   /*!< ...of which from the magazine. */
+    unsigned long long free_cnt;        /*!< Objects freed. */
+    size_t slab_cnt;                    /*!< Slabs currently allocated. */
+};
+
+/*! A slab, at the start of its page, followed by its objects. */
+typedef struct slab {
+    unsigned magic;             /*!< Always set to SLAB_MAGIC. */
+    kmem_cache_t *cache;        /*!< Owning cache. */
+    list_elem_t elem;           /*!< Element in the cache's slab list. */
+    size_t free_cnt;            /*!< Number of free objects. */
+    void *free;                 /*!< First free object, or null. */
+} slab_t;
+
+/*! Our set of caches. */
+static kmem_cache_t caches[MAX_CACHES];
+static size_t cache_cnt;
+
+/*! Creates a cache named NAME of objects of SIZE bytes, which are put in
+    their constructed state by CTOR if it is non-null. Caches are never
+    destroyed, and must be created before other threads can use them. */
+kmem_cache_t *kmem_cache_create(const char *name, size_t size,
+                                kmem_ctor_func *ctor) {
+    ASSERT(size > 0);
+    if (cache_cnt >= MAX_CACHES) {
+        PANIC("kmem_cache_create: too many caches");
+    }
+    kmem_cache_t *c = &caches[cache_cnt++];
+    size = ROUND_UP(size, sizeof(void *));
+
+    c->name = name;
+    c->obj_size = size;
+    c->ctor = ctor;
+    c->link_ofs = ctor != NULL ? size : 0;
+    c->slot_size = ctor != NULL ? size + sizeof(void *) : size;
+    c->objs_per_slab = (PGSIZE - sizeof(slab_t)) / c->slot_size;
+    ASSERT(c->objs_per_slab > 0);
+    lock_init(&c->lock);
+    list_init(&c->slabs);
+    return c;
+}
+
+/*! Returns the free list link of OBJ in cache C. */
+static void **obj_link(kmem_cache_t *c, void *obj) {
+    return (void **) ((uint8_t *) obj + c->link_ofs);
+}
+
+/*! Returns the slab that OBJ of cache C is inside. */
+static slab_t *obj_to_slab(kmem_cache_t *c, void *obj) {
+    slab_t *s = pg_round_down(obj);
+
+    ASSERT(s->magic == SLAB_MAGIC);
+    ASSERT(s->cache == c);
+    ASSERT((pg_ofs(obj) - sizeof *s) % c->slot_size == 0);
+    return s;
+}
+
+/*! Allocates a new slab for C, constructs its objects and puts it on the
+    slab list. Returns false if out of memory. Must hold C's lock. */
+static bool slab_create(kmem_cache_t *c) {
+    slab_t *s = palloc_get_page(0);
+    if (s == NULL) return false;
+
+    s->magic = SLAB_MAGIC;
+    s->cache = c;
+    s->free_cnt = c->objs_per_slab;
+    s->free = NULL;
+    for (size_t i = c->objs_per_slab; i-- > 0; ) {
+        void *obj = (uint8_t *) (s + 1) + i * c->slot_size;
+        if (c->ctor != NULL) c->ctor(obj);
+        *obj_link(c, obj) = s->free;
+        s->free = obj;
+    }
+    list_push_front(&c->slabs, &s->elem);
+    c->empty_cnt++;
+    c->slab_cnt++;
+    return true;
+}
+
+/*! Takes an object from C's slabs, creating a slab if they are all full.
+    Returns a null pointer if out of memory. Must hold C's lock. */
+static void *slab_alloc(kmem_cache_t *c) {
+    if (list_empty(&c->slabs) && !slab_create(c)) return NULL;
+
+    slab_t *s = list_entry(list_front(&c->slabs), slab_t, elem);
+    void *obj = s->free;
+    if (s->free_cnt-- == c->objs_per_slab) c->empty_cnt--;
+    s->free = *obj_link(c, obj);
+    if (s->free_cnt == 0) list_remove(&s->elem);
+    return obj;
+}
+
+/*! Returns OBJ to its slab of C. A slab which becomes entirely free is
+    given back to the page allocator, unless it is the only such slab, which
+    is kept to avoid allocating a page for the next object. Must hold C's
+    lock. */
+static void slab_free(kmem_cache_t *c, void *obj) {
+    slab_t *s = obj_to_slab(c, obj);
+
+    *obj_link(c, obj) = s->free;
+    s->free = obj;
+    if (s->free_cnt++ == 0) list_push_front(&c->slabs, &s->elem);
+    if (s->free_cnt == c->objs_per_slab) {
+        if (c->empty_cnt > 0) {
+            list_remove(&s->elem);
+            s->magic = 0;
+            palloc_free_page(s);
+            c->slab_cnt--;
+        } else {
+            c->empty_cnt++;
+        }
+    }
+}
+
+/*! Obtains and returns an object from cache C, in its constructed state if C
+    has a constructor. Returns a null pointer if memory is not available. */
+void *kmem_cache_alloc(kmem_cache_t *c) {
+    ASSERT(!intr_context());
+
+    enum intr_level old_level = intr_disable();
+    if (c->magazine_cnt > 0) {
+        void *obj = c->magazine[--c->magazine_cnt];
+        c->alloc_cnt++;
+        c->magazine_hits++;
+        intr_set_level(old_level);
+        return obj;
+    }
+    intr_set_level(old_level);
+
+    /* The magazine is empty, so refill half of it from the slabs which
+       already exist while we hold the lock. */
+    void *batch[MAGAZINE_SIZE / 2];
+    size_t batch_cnt = 0;
+    lock_acquire(&c->lock);
+    void *obj = slab_alloc(c);
+    while (obj != NULL && batch_cnt < MAGAZINE_SIZE / 2
+           && !list_empty(&c->slabs)) {
+        batch[batch_cnt++] = slab_alloc(c);
+    }
+    lock_release(&c->lock);
+
+    old_level = intr_disable();
+    while (batch_cnt > 0 && c->magazine_cnt < MAGAZINE_SIZE) {
+        c->magazine[c->magazine_cnt++] = batch[--batch_cnt];
+    }
+    if (obj != NULL) c->alloc_cnt++;
+    intr_set_level(old_level);
+
+    if (batch_cnt > 0) {
+        /* Others refilled the magazine meanwhile. */
+        lock_acquire(&c->lock);
+        while (batch_cnt > 0) slab_free(c, batch[--batch_cnt]);
+        lock_release(&c->lock);
+    }
+    return obj;
+}
+
+/*! Frees OBJ, which must have been allocated from cache C and, if C has a
+    constructor, be in its constructed state. */
+void kmem_cache_free(kmem_cache_t *c, void *obj) {
+    ASSERT(!intr_context());
+    if (obj == NULL) return;
+
+#ifndef NDEBUG
+    /* Clear the object to help detect use-after-free bugs. */
+    if (c->ctor == NULL) memset(obj, 0xcc, c->obj_size);
+#endif
+
+    void *batch[MAGAZINE_SIZE / 2 + 1];
+    size_t batch_cnt = 0;
+    enum intr_level old_level = intr_disable();
+    c->free_cnt++;
+    if (c->magazine_cnt < MAGAZINE_SIZE) {
+        c->magazine[c->magazine_cnt++] = obj;
+        intr_set_level(old_level);
+        return;
+    }
+
+    /* The magazine is full, so empty half of it into the slabs. */
+    batch[batch_cnt++] = obj;
+    while (batch_cnt <= MAGAZINE_SIZE / 2) {
+        batch[batch_cnt++] = c->magazine[--c->magazine_cnt];
+    }
+    intr_set_level(old_level);
+
+    lock_acquire(&c->lock);
+    while (batch_cnt > 0) slab_free(c, batch[--batch_cnt]);
+    lock_release(&c->lock);
+}
+
+/*! Prints statistics about each cache. */
+void kmem_print_stats(void) {
+    for (size_t i = 0; i < cache_cnt; i++) {
+        kmem_cache_t *c = &caches[i];
+        printf("Cache %s: %zu-byte objects, %llu allocs (%llu from magazine), "
+               "%llu frees, %zu slabs\n", c->name, c->obj_size, c->alloc_cnt,
+               c->magazine_hits, c->free_cnt, c->slab_cnt);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/*! A cache of objects of one type. */
+typedef struct kmem_cache kmem_cache_t;
+
+/*! Puts a newly allocated object OBJ into its constructed state. */
+typedef void kmem_ctor_func(void *obj);
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size,
+                                kmem_ctor_func *ctor);
+void *kmem_cache_alloc(kmem_cache_t *);
+void kmem_cache_free(kmem_cache_t *, void *);
+void kmem_print_stats(void);
+
+#endif /* threads/slab.h */
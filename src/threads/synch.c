@@ -38,6 +38,21 @@
 #include "threads/thread.h"
 #include "devices/timer.h"
 
+#ifdef LOCK_PROFILE
+/*! Most distinct names of profiled locks. */
+#define MAX_PROFILES 64
+
+/*! Number of locks reported at shutdown. */
+#define LOCK_STATS_TOP 10
+
+/*! Statistics for each name given to a lock. */
+static lock_stats_t profiles[MAX_PROFILES];
+static size_t profile_cnt;
+
+static void profile_acquire(lock_stats_t *, bool contended, int64_t start);
+static void profile_release(lock_stats_t *, int64_t since);
+#endif
+
 /*! Gets the lock that the given semaphore is a member of. Assumes that the
     given semaphore is a lock semaphore. Behavior undefined otherwise. */
 static inline lock_t *lock_from_sema(semaphore_t *sema) {
@@ -68,12 +83,18 @@ void sema_init(semaphore_t *sema, unsigned value) {
 
     sema->value = value;
     list_init(&sema->waiters);
+#ifdef LOCK_PROFILE
+    sema->stats = NULL;
+#endif
 }
 
 /*! Propogate priority donation through lock. */
 void lock_gained_priority_donor(lock_t *lock, int donation) {
     if (lock->priority < donation) {
         lock->priority = donation;
+#ifdef LOCK_PROFILE
+        if (lock->semaphore.stats != NULL) lock->semaphore.stats->donations++;
+#endif
         if (lock->holder != NULL) {
             thread_gained_priority_donor(lock->holder, lock->priority);
         }
@@ -93,6 +114,10 @@ static void _sema_down(semaphore_t *sema, bool islock) {
     old_level = intr_disable();
 
     cur = thread_current();
+#ifdef LOCK_PROFILE
+    bool contended = sema->value == 0;
+    int64_t start = ticks;
+#endif
 
     while (sema->value == 0) {
         list_push_back(&sema->waiters, &cur->elem);
@@ -104,6 +129,9 @@ static void _sema_down(semaphore_t *sema, bool islock) {
         thread_block();
     }
     sema->value--;
+#ifdef LOCK_PROFILE
+    profile_acquire(sema->stats, contended, start);
+#endif
     intr_set_level(old_level);
 }
 
@@ -133,6 +161,9 @@ bool sema_try_down(semaphore_t *sema) {
     if (sema->value > 0) {
         sema->value--;
         success = true;
+#ifdef LOCK_PROFILE
+        profile_acquire(sema->stats, false, 0);
+#endif
     }
     else {
       success = false;
@@ -334,6 +365,9 @@ void lock_acquire(lock_t *lock) {
         list_push_back(&cur->held_locks, &lock->elem);
     }
     lock->holder = cur;
+#ifdef LOCK_PROFILE
+    lock->acquired_at = ticks;
+#endif
     intr_set_level(old_level);
 }
 
@@ -353,6 +387,9 @@ bool lock_try_acquire(lock_t *lock) {
     success = sema_try_down(&lock->semaphore);
     if (success) {
         lock->holder = thread_current();
+#ifdef LOCK_PROFILE
+        lock->acquired_at = ticks;
+#endif
         if (!thread_mlfqs) {
             list_push_back(&lock->holder->held_locks, &lock->elem);
         }
@@ -374,6 +411,9 @@ void lock_release(lock_t *lock) {
     enum intr_level old_level = intr_disable();
     lock->holder = NULL;
     semaphore_t *sema = &lock->semaphore;
+#ifdef LOCK_PROFILE
+    profile_release(sema->stats, lock->acquired_at);
+#endif
     sema_up(&lock->semaphore);
     if (!thread_mlfqs) {
         int old_lock_priority = lock->priority;
@@ -525,6 +565,9 @@ void rw_init(rwlock_t *lock) {
     lock->num_holders = 0;
     list_init(&lock->r_waiters);
     list_init(&lock->w_waiters);
+#ifdef LOCK_PROFILE
+    lock->stats = NULL;
+#endif
 }
 
 /*! Obtains a read/write lock as a reader, blocking if it's held by a writer or
@@ -535,12 +578,21 @@ void rw_read_acquire(rwlock_t *lock) {
 
     cur->time = timer_ticks();
     enum intr_level old_level = intr_disable();
+#ifdef LOCK_PROFILE
+    bool contended = false;
+#endif
     while (lock->num_holders < 0 || cur->time > front_write_waiter_time(lock)) {
         list_push_back(&lock->r_waiters, &cur->elem);
         thread_block();
+#ifdef LOCK_PROFILE
+        contended = true;
+#endif
     }
     ASSERT(lock->num_holders >= 0);
     lock->num_holders++;
+#ifdef LOCK_PROFILE
+    profile_acquire(lock->stats, contended, cur->time);
+#endif
     intr_set_level(old_level);
 }
 
@@ -567,12 +619,22 @@ void rw_write_acquire(rwlock_t *lock) {
 
     cur->time = timer_ticks();
     enum intr_level old_level = intr_disable();
+#ifdef LOCK_PROFILE
+    bool contended = false;
+#endif
     while (lock->num_holders != 0) {
         list_push_back(&lock->w_waiters, &cur->elem);
         thread_block();
+#ifdef LOCK_PROFILE
+        contended = true;
+#endif
     }
     ASSERT(lock->num_holders == 0);
     lock->num_holders = -1;
+#ifdef LOCK_PROFILE
+    profile_acquire(lock->stats, contended, cur->time);
+    lock->acquired_at = ticks;
+#endif
     intr_set_level(old_level);
 }
 
@@ -584,7 +646,142 @@ void rw_write_release(rwlock_t *lock) {
 
     enum intr_level old_level = intr_disable();
     ASSERT(++lock->num_holders == 0);
+#ifdef LOCK_PROFILE
+    profile_release(lock->stats, lock->acquired_at);
+#endif
     rw_unblock_waiters(lock);
 
     intr_set_level(old_level);
-}
\ No newline at end of file
+}
+#ifdef LOCK_PROFILE
+/*! Returns the statistics for locks named NAME, creating them if need be, or
+    a null pointer if there are already too many names. */
+static lock_stats_t *profile_lookup(const char *name) {
+    lock_stats_t *stats = NULL;
+
+    ASSERT(name != NULL);
+
+    enum intr_level old_level = intr_disable();
+    for (size_t i = 0; i < profile_cnt; i++) {
+        if (profiles[i].name == name || !strcmp(profiles[i].name, name)) {
+            stats = &profiles[i];
+            break;
+        }
+    }
+    if (stats == NULL && profile_cnt < MAX_PROFILES) {
+        stats = &profiles[profile_cnt++];
+        stats->name = name;
+    }
+    intr_set_level(old_level);
+    return stats;
+}
+
+/*! Profiles semaphore SEMA under NAME. */
+void sema_set_name(semaphore_t *sema, const char *name) {
+    ASSERT(sema != NULL);
+    sema->stats = profile_lookup(name);
+}
+
+/*! Profiles LOCK under NAME. */
+void lock_set_name(lock_t *lock, const char *name) {
+    ASSERT(lock != NULL);
+    sema_set_name(&lock->semaphore, name);
+}
+
+/*! Profiles read/write lock LOCK under NAME. */
+void rw_set_name(rwlock_t *lock, const char *name) {
+    ASSERT(lock != NULL);
+    lock->stats = profile_lookup(name);
+}
+
+/*! Records an acquisition of a lock with statistics STATS, if it is
+    profiled, which waited since tick START if CONTENDED. Interrupts must be
+    off. */
+static void profile_acquire(lock_stats_t *stats, bool contended,
+                            int64_t start) {
+    if (stats == NULL) return;
+
+    stats->acquires++;
+    if (contended) {
+        int64_t wait = ticks - start;
+        stats->contended++;
+        stats->wait_ticks += wait;
+        if (wait > stats->max_wait) stats->max_wait = wait;
+    }
+}
+
+/*! Records the release of a lock with statistics STATS, if it is profiled,
+    which was acquired at tick SINCE. Interrupts must be off. */
+static void profile_release(lock_stats_t *stats, int64_t since) {
+    if (stats == NULL) return;
+
+    int64_t hold = ticks - since;
+    stats->hold_ticks += hold;
+    if (hold > stats->max_hold) stats->max_hold = hold;
+}
+
+/*! Orders statistics from most to least contended: by time spent waiting,
+    then by number of contended acquisitions. */
+static bool profile_more(const lock_stats_t *a, const lock_stats_t *b) {
+    if (a->wait_ticks != b->wait_ticks) return a->wait_ticks > b->wait_ticks;
+    return a->contended > b->contended;
+}
+
+/*! Stores pointers to the statistics of up to N locks, most contended first,
+    in TOP[]. Returns the number stored. */
+static size_t profile_top(const lock_stats_t **top, size_t n) {
+    size_t cnt = 0;
+
+    enum intr_level old_level = intr_disable();
+    for (size_t i = 0; i < profile_cnt; i++) {
+        const lock_stats_t *stats = &profiles[i];
+        size_t j = cnt < n ? cnt++ : n;
+        while (j > 0 && profile_more(stats, top[j - 1])) {
+            if (j < n) top[j] = top[j - 1];
+            j--;
+        }
+        if (j < n) top[j] = stats;
+    }
+    intr_set_level(old_level);
+    return cnt;
+}
+
+/*! Formats STATS as a line of text into the SIZE bytes of BUF, as with
+    snprintf(). */
+static int profile_format(char *buf, size_t size, const lock_stats_t *stats) {
+    return snprintf(buf, size, "%-20s %8llu acquires %8llu contended "
+                    "wait %lld (max %lld) hold %lld (max %lld) "
+                    "%llu donations\n", stats->name, stats->acquires,
+                    stats->contended, stats->wait_ticks, stats->max_wait,
+                    stats->hold_ticks, stats->max_hold, stats->donations);
+}
+
+/*! Formats the statistics of all profiled locks, most contended first, into
+    the SIZE bytes of BUF, one line each. Returns the number of bytes
+    written, not counting the null terminator. */
+size_t lock_stats_format(char *buf, size_t size) {
+    const lock_stats_t *top[MAX_PROFILES];
+    size_t cnt = profile_top(top, MAX_PROFILES);
+    size_t len = 0;
+
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < cnt && len + 1 < size; i++) {
+        len += profile_format(buf + len, size - len, top[i]);
+    }
+    return len < size ? len : size - 1;
+}
+
+/*! Prints the statistics of the most contended locks. Times are in
+    ticks. */
+void lock_print_stats(void) {
+    const lock_stats_t *top[LOCK_STATS_TOP];
+    size_t cnt = profile_top(top, LOCK_STATS_TOP);
+    char line[160];
+
+    for (size_t i = 0; i < cnt; i++) {
+        profile_format(line, sizeof line, top[i]);
+        printf("Lock %s", line);
+    }
+}
+#endif
@@ -10,10 +10,29 @@
 #include <list.h>
 #include <stdbool.h>
 
+#ifdef LOCK_PROFILE
+/*! Contention statistics shared by the semaphores, locks or rwlocks given
+    the same name. Times are in timer ticks. */
+typedef struct lock_stats {
+    const char *name;               /*!< Name of the lock or class of locks. */
+    unsigned long long acquires;    /*!< Successful downs or acquisitions. */
+    unsigned long long contended;   /*!< ...of which had to wait. */
+    long long wait_ticks;           /*!< Total time spent waiting. */
+    long long max_wait;             /*!< Longest wait. */
+    long long hold_ticks;           /*!< Total time held, for locks and
+                                         rwlocks held for writing. */
+    long long max_hold;             /*!< Longest hold. */
+    unsigned long long donations;   /*!< Priority donations through it. */
+} lock_stats_t;
+#endif
+
 /*! A counting semaphore. */
 typedef struct semaphore {
     unsigned value;         /*!< Current value. */
     list_t waiters;         /*!< List of waiting threads. */
+#ifdef LOCK_PROFILE
+    lock_stats_t *stats;    /*!< Statistics, or null if not profiled. */
+#endif
 } semaphore_t;
 
 /*! Preprocessor initializer for semaphore starting at n.
@@ -48,6 +67,9 @@ typedef struct lock {
     semaphore_t semaphore;      /*!< Binary semaphore controlling access. */
     int priority;               /*!< Max priority of threads blocking on lock. */
     list_elem_t elem;           /*!< List element for threads to hold. */
+#ifdef LOCK_PROFILE
+    int64_t acquired_at;        /*!< Tick at which it was acquired. */
+#endif
 } lock_t;
 
 /*! Preprocessor initializer for lock.
@@ -73,6 +95,10 @@ typedef struct rwlock {
     /*! The number of holders of the lock as readers. Writers are treated as
         negative, so the value of num_holders ranges from -1 to INT32_MAX. */
     int32_t num_holders;
+#ifdef LOCK_PROFILE
+    lock_stats_t *stats;        /*!< Statistics, or null if not profiled. */
+    int64_t acquired_at;        /*!< Tick at which a writer acquired it. */
+#endif
 } rwlock_t;
 
 void rw_init(rwlock_t *);
@@ -83,6 +109,21 @@ void rw_write_acquire(rwlock_t *);
 void rw_write_release(rwlock_t *);
 bool rw_write_held_by_current_thread(const rwlock_t *);
 
+/* Lock profiling. Each name given to a semaphore, lock or rwlock gets one
+   set of statistics, shared by all those given that name. Without
+   LOCK_PROFILE, naming does nothing and costs nothing. */
+#ifdef LOCK_PROFILE
+void sema_set_name(semaphore_t *, const char *name);
+void lock_set_name(lock_t *, const char *name);
+void rw_set_name(rwlock_t *, const char *name);
+size_t lock_stats_format(char *buf, size_t size);
+void lock_print_stats(void);
+#else
+#define sema_set_name(SEMA, NAME) ((void) 0)
+#define lock_set_name(LOCK, NAME) ((void) 0)
+#define rw_set_name(LOCK, NAME) ((void) 0)
+#endif
+
 /*! Condition variable.
     A condition variable can be implemented as a semaphore without additional
     fields */
@@ -11,10 +11,12 @@
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/fixedpoint.h"
 #include "devices/timer.h"
 #ifdef USERPROG
+#include "userprog/kdata.h"
 #include "userprog/process.h"
 #include "vm/frametbl.h"
 #endif
@@ -45,9 +47,6 @@ typedef struct ready_queue {
     char bitmap_buf[BITMAP_BUF_SIZE(PRI_CNT)];
 } ready_queue_t;
 
-/*! List of processes currently asleep. */
-static list_t sleeping_list;
-
 // /*! List of processes in THREAD_READY state, that is, processes
 //     that are ready to run but not actually running. */
 // static list_t ready_list;
@@ -58,7 +57,7 @@ static ready_queue_t ready_queue;
 
 /*! Hash of all processes.  Processes are added to this list
     when they are first scheduled and removed when they exit. */
-static hash_t all_hash;
+static ihash_t all_hash;
 
 /*! Idle thread. */
 static thread_t *idle_thread;
@@ -80,7 +79,7 @@ static long long kernel_ticks;  /*!< # of timer ticks in kernel threads. */
 static long long user_ticks;    /*!< # of timer ticks in user programs. */
 
 /* Scheduling. */
-#define TIME_SLICE 4            /*!< # of timer ticks to give each thread. */
+size_t thread_time_slice = 4;   /*!< # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /*!< # of timer ticks since last yield. */
 
 /*! If false (default), use round-robin scheduler.
@@ -91,6 +90,20 @@ bool thread_mlfqs;
 /*! Overall system load average. */
 static fp_val load_avg;
 
+/*! Number of per-second recent_cpu decays kept for threads to catch up on.
+    A thread which has missed more starts again from a recent_cpu of 0 and
+    applies only the decays kept. Its old recent_cpu would by then have been
+    scaled by at least DECAY_HISTORY factors below 1, so this slightly
+    underestimates it, and mostly when the load average is high. */
+#define DECAY_HISTORY 64
+
+/*! Factors by which recent_cpu decayed in recent seconds, indexed by decay
+    number modulo DECAY_HISTORY, and the number of decays so far. Threads
+    which are not running apply the decays they missed when they are next
+    looked at, rather than all threads being decayed every second. */
+static fp_val decay_factors[DECAY_HISTORY];
+static long long decay_cnt;
+
 /*! Lock used by allocate_tid(). */
 static lock_t tid_lock;
 
@@ -115,7 +128,8 @@ static void thread_decreased_priority(void);
 static void calculate_load_avg(void);
 fp_val _thread_get_recent_cpu(void);
 static void calculate_priority(thread_t *t, void *aux UNUSED);
-static void calculate_recent_cpu(thread_t *t, void *aux UNUSED);
+static void calculate_recent_cpu(thread_t *t);
+static void record_decay(void);
 static int _calculate_priority(fp_val recent_cpu, int nice);
 static size_t num_ready_threads(void);
 static tid_t allocate_tid(void);
@@ -128,8 +142,8 @@ inline thread_t *list_entry_thread(const list_elem_t *e) {
 }
 
 /*! Shorthand function to get thread from its hash element */
-static inline thread_t *th_entry(const hash_elem_t *e) {
-    return hash_entry(e, thread_t, allelem);
+static inline thread_t *th_entry(const ihash_elem_t *e) {
+    return ihash_entry(e, thread_t, allelem);
 }
 
 /*! Computes the hash of a tid, for use by any external code which wants to hash
@@ -145,10 +159,10 @@ bool tid_less(tid_t a, tid_t b) {
 }
 
 /*! All thread hash hash function and comparison function. */
-static unsigned thread_hash_hash(const hash_elem_t *e, void *aux UNUSED) {
+static unsigned thread_hash_hash(const ihash_elem_t *e, void *aux UNUSED) {
     return tid_hash(th_entry(e)->tid);
 }
-static bool thread_hash_less(const hash_elem_t *a, const hash_elem_t *b,
+static bool thread_hash_less(const ihash_elem_t *a, const ihash_elem_t *b,
                         void *aux UNUSED) {
     return tid_less(th_entry(a)->tid, th_entry(b)->tid);
 }
@@ -168,7 +182,6 @@ void thread_init(void) {
     ASSERT(intr_get_level() == INTR_OFF);
 
     init_ready_queue();
-    list_init(&sleeping_list);
     lock_init(&tid_lock);
 
     load_avg = FP(0);
@@ -189,7 +202,7 @@ void thread_start(void) {
     /* Create the idle thread. */
     semaphore_t idle_started;
     sema_init(&idle_started, 0);
-    ASSERT(hash_init(&all_hash, thread_hash_hash, thread_hash_less, NULL));
+    ASSERT(ihash_init(&all_hash, thread_hash_hash, thread_hash_less, NULL));
     register_thread(initial_thread);
     thread_create("idle", PRI_MIN, idle, &idle_started);
 
@@ -200,9 +213,10 @@ void thread_start(void) {
     sema_down(&idle_started);
 }
 
-/*! Called by the timer interrupt handler at each timer tick.
+/*! Called by the timer interrupt handler at each timer tick, with USER true
+    if the tick interrupted user code.
     Thus, this function runs in an external interrupt context. */
-void thread_tick(void) {
+void thread_tick(bool user) {
     thread_t *t = thread_current();
 
     // enum intr_level old_level = intr_disable();
@@ -215,35 +229,39 @@ void thread_tick(void) {
 #ifdef USERPROG
     else if (!sup_pt_is_kernel(&t->pt)) {
         user_ticks++;
-        // parameters suggested by Eric Paul, who had absolutely no idea what
-        // they meant but they worked pretty well.
-        const size_t BLOCK_CNT = 2;
-        const size_t AGE_FREQ = 2;
-        if (user_ticks % AGE_FREQ == 0) {
-            frametbl_tick((user_ticks / AGE_FREQ) % BLOCK_CNT, BLOCK_CNT);
-        }
+        frametbl_tick();
     }
 #endif
     else {
         kernel_ticks++;
     }
+    if (t != idle_thread) {
+        if (user)
+            t->usage.user_ticks++;
+        else
+            t->usage.kernel_ticks++;
+    }
 
     if (thread_mlfqs) {
         t->recent_cpu = FP_ADD(t->recent_cpu, 1);
     }
     if (thread_mlfqs && ticks % TIMER_FREQ == 0) {
         calculate_load_avg(); // Recalculate load average, globally
-        thread_foreach(calculate_recent_cpu, NULL); // Update recent cpus
+        record_decay(); // Other threads' recent cpus decay lazily
     }
+#ifdef USERPROG
+    kdata_update(); // Publish the new tick count to user programs
+#endif
     if (thread_mlfqs && ticks % PRIORITY_FREQ == 0) {
-        thread_foreach(calculate_priority, NULL); // Update priorities
+        // Only the running thread's recent cpu has grown
+        calculate_priority(t, NULL);
         if (t != idle_thread && t->priority < highest_ready_priority()) { // Yield if necessary
             intr_yield_on_return();
         }
     }
 
     /* Enforce preemption. */
-    if (++thread_ticks >= TIME_SLICE)
+    if (++thread_ticks >= thread_time_slice)
         intr_yield_on_return();
 
     // intr_set_level(old_level);
@@ -384,7 +402,7 @@ tid_t thread_tid(void) {
 static void register_thread(thread_t *t) {
     ASSERT(intr_get_level() == INTR_OFF);
 
-    hash_insert(&all_hash, &t->allelem);
+    ihash_insert(&all_hash, &t->allelem);
 }
 
 /*! Removes a thread from the all threads hash map.
@@ -392,7 +410,7 @@ static void register_thread(thread_t *t) {
 static void remove_thread(thread_t *t) {
     ASSERT(intr_get_level() == INTR_OFF);
 
-    hash_delete(&all_hash, &t->allelem);
+    ihash_delete(&all_hash, &t->allelem);
 }
 
 /*! Looks up thread by its tid. Returns NULL if given an invalid tid, including
@@ -401,7 +419,7 @@ thread_t *get_thread(tid_t tid) {
     // Current implementation of `tid_t` is an alias for thread_t *
     thread_t search = {.tid = tid};
     enum intr_level old_level = intr_disable();
-    thread_t *t = th_entry(hash_find(&all_hash, &search.allelem));
+    thread_t *t = th_entry(ihash_find(&all_hash, &search.allelem));
     intr_set_level(old_level);
     return t;
 }
@@ -440,14 +458,9 @@ void thread_yield(void) {
     intr_set_level(old_level);
 }
 
-/*! Indicates whether thread represented by `a` should wake up after thread
-    represented by `b`. */
-static bool thread_wake_less(const list_elem_t *a,
-                             const list_elem_t *b,
-                             void *aux UNUSED) {
-    thread_t *ta = list_entry_thread(a);
-    thread_t *tb = list_entry_thread(b);
-    return ta->time < tb->time;
+/*! Wakes up thread T, whose sleep timer has expired. */
+static void thread_wake(ktimer_t *timer UNUSED, void *t) {
+    thread_unblock(t);
 }
 
 /*! Yields the CPU for at least `for_ticks` ticks, after which it may be
@@ -460,43 +473,38 @@ void thread_sleep(int64_t for_ticks) {
     }
     thread_t *cur = thread_current();
     enum intr_level old_level;
+    ktimer_t timer;
 
     ASSERT(!intr_context());
     ASSERT(cur != idle_thread);
 
+    ktimer_init(&timer, thread_wake, cur);
     old_level = intr_disable();
-    cur->time = ticks + for_ticks;
-    list_insert_ordered(&sleeping_list, &cur->elem, thread_wake_less, NULL);
+    ktimer_set(&timer, ticks + for_ticks);
     thread_block();
     intr_set_level(old_level);
 }
 
-/*! Wakes up all sleeping threads whose wake up time is less than the current
-    global tick. Assumes interrupts are disabled. */
-static inline void thread_alarm_clock(void) {
-    while (!list_empty(&sleeping_list) &&
-        list_entry_thread(list_front(&sleeping_list))->time <= ticks
-    ) {
-        thread_unblock(list_entry_thread(list_pop_front(&sleeping_list)));
-    }
-}
-
 /*! Invoke function 'func' on all threads, passing along 'aux'.
     This function must be called with interrupts off. */
 void thread_foreach(thread_action_func *func, void *aux) {
     ASSERT(intr_get_level() == INTR_OFF);
-    hash_iterator_t i;
-    hash_first(&i, &all_hash);
-    while (hash_next(&i)) {
-        func(th_entry(hash_cur(&i)), aux);
+    ihash_iterator_t i;
+    ihash_first(&i, &all_hash);
+    while (ihash_next(&i)) {
+        func(th_entry(ihash_cur(&i)), aux);
     }
 }
 
 /*! Relinquishish control if the running thread no longer has the highest
-    priority. */
+    priority. In an interrupt handler, yields on return from the interrupt. */
 void thread_yield_if_lost_primacy(void) {
     if (highest_ready_priority() > thread_get_priority()) {
-        thread_yield();
+        if (intr_context()) {
+            intr_yield_on_return();
+        } else {
+            thread_yield();
+        }
     }
 }
 
@@ -557,18 +565,32 @@ int thread_get_priority(void) {
     return thread_current()->priority;
 }
 
-/*! Given a thread, recalculates its recent cpu usage. */
-static void calculate_recent_cpu(thread_t *t, void *aux UNUSED) {
+/*! Records the factor by which recent cpu usage decays this second, from
+    the new load average, and applies it to the running thread. */
+static void record_decay(void) {
     ASSERT(thread_mlfqs);
-    if (t != idle_thread) {
+    decay_factors[decay_cnt++ % DECAY_HISTORY] = FP_DIV(
+        FP_MUL(load_avg, 2),
+        FP_ADD(FP_MUL(load_avg, 2), 1)
+    );
+    calculate_recent_cpu(thread_current());
+}
+
+/*! Given a thread, brings its recent cpu usage up to date by applying the
+    decays it has missed. Interrupts must be off. */
+static void calculate_recent_cpu(thread_t *t) {
+    ASSERT(thread_mlfqs);
+    ASSERT(intr_get_level() == INTR_OFF);
+    if (t == idle_thread) {
+        return;
+    }
+    if (decay_cnt - t->decays > DECAY_HISTORY) {
+        t->recent_cpu = FP(0);
+        t->decays = decay_cnt - DECAY_HISTORY;
+    }
+    for (; t->decays < decay_cnt; t->decays++) {
         t->recent_cpu = FP_ADD(
-            FP_MUL(
-                FP_DIV(
-                    FP_MUL(load_avg, 2),
-                    FP_ADD(FP_MUL(load_avg, 2), 1)
-                ),
-                t->recent_cpu
-            ),
+            FP_MUL(decay_factors[t->decays % DECAY_HISTORY], t->recent_cpu),
             t->nice
         );
     }
@@ -581,6 +603,7 @@ static void calculate_recent_cpu(thread_t *t, void *aux UNUSED) {
 static void calculate_priority(thread_t *t, void *aux UNUSED) {
     if (t != idle_thread) {
         int old_priority = t->priority;
+        calculate_recent_cpu(t);
         t->priority = _calculate_priority(t->recent_cpu, t->nice);
         if (old_priority < t->priority) {
             thread_increased_priority(t, old_priority);
@@ -741,6 +764,11 @@ static void init_ready_queue(void) {
 static void enqueue_ready_thread(thread_t *t) {
     ASSERT(intr_get_level() == INTR_OFF);
 
+    if (thread_mlfqs && t != idle_thread) {
+        // Catch up on the decays missed while blocked or waiting
+        calculate_recent_cpu(t);
+        t->priority = _calculate_priority(t->recent_cpu, t->nice);
+    }
     size_t pri_i = t->priority - PRI_MIN;
     list_push_back(&ready_queue.queues[pri_i], &t->elem);
     bitmap_mark(ready_queue.populated_queues, pri_i);
@@ -763,6 +791,9 @@ static thread_t *dequeue_ready_thread(void) {
         bitmap_reset(ready_queue.populated_queues, i);
     }
     ready_queue.num_ready_threads--;
+    if (thread_mlfqs) {
+        calculate_recent_cpu(first);
+    }
     return first;
 }
 
@@ -827,6 +858,9 @@ static void idle(void *idle_started_ UNUSED) {
         intr_disable();
         thread_block();
 
+        /* Let the timer skip ticks while we wait, if it can. */
+        timer_idle_enter();
+
         /* Re-enable interrupts and wait for the next one.
 
            The `sti' instruction disables interrupts until the completion of
@@ -882,6 +916,7 @@ static void init_thread(thread_t *t, const char *name, int priority, int nice,
     t->priority = priority;
     t->nice = nice;
     t->recent_cpu = recent_cpu;
+    t->decays = decay_cnt;
     t->base_priority = priority;
     t->magic = THREAD_MAGIC;
     list_init(&t->held_locks);
@@ -907,7 +942,6 @@ static void * alloc_frame(thread_t *t, size_t size) {
     thread can continue running, then it will be in the run queue.)  If the
     run queue is empty, return idle_thread. */
 static thread_t * next_thread_to_run(void) {
-    thread_alarm_clock();
     thread_t *ready = dequeue_ready_thread();
     return ready != NULL ? ready : idle_thread;
 }
@@ -937,6 +971,10 @@ void thread_schedule_tail(thread_t *prev) {
     /* Start new time slice. */
     thread_ticks = 0;
 
+    /* Have the timer tick again if we were idle. */
+    if (prev != NULL && prev == idle_thread)
+        timer_idle_exit();
+
 #ifdef USERPROG
     /* Activate the new address space. */
     process_activate();
@@ -968,8 +1006,14 @@ static void schedule(void) {
     ASSERT(cur->status != THREAD_RUNNING);
     ASSERT(is_thread(next));
 
-    if (cur != next)
+    if (cur != next) {
+        TRACE(TRACE_SCHEDULE, cur->tid, next->tid, cur->status);
+        if (cur->status == THREAD_READY)
+            cur->usage.involuntary_switches++;
+        else if (cur->status == THREAD_BLOCKED)
+            cur->usage.voluntary_switches++;
         prev = switch_threads(cur, next);
+    }
     thread_schedule_tail(prev);
 }
 
@@ -8,7 +8,8 @@
 
 #include <debug.h>
 #include <list.h>
-#include <hash.h>
+#include <ihash.h>
+#include <rusage.h>
 #include <stdint.h>
 
 #include "synch.h"
@@ -109,9 +110,14 @@ typedef struct thread {
     int base_priority;              /*!< Priority without donations. */
     int nice;                       /*!< Thread's niceness value. */
     fp_val recent_cpu;              /*!< Metric of CPU time used recently. */
-    int64_t time;                   /*!< Stores a time. This is used both by the
-                                         sleep mechanism and read write locks. */
-    hash_elem_t allelem;            /*!< Hash element for all threads hash. */
+    long long decays;               /*!< Number of per-second decays applied
+                                         to recent_cpu. */
+    int64_t time;                   /*!< Stores a time. This is used by read
+                                         write locks. */
+    ihash_elem_t allelem;            /*!< Hash element for all threads hash. */
+    struct rusage usage;            /*!< Resources used, updated by the timer,
+                                         scheduler, page fault handler and
+                                         system calls. */
     /**@}*/
 
     /*! Shared between thread.c and synch.c. */
@@ -135,6 +141,8 @@ typedef struct thread {
     void *stack_pointer;            /*!< The stack pointer of the user process,
                                          if executing a syscall. */
     dir_t *wd;                      /*<! Working directory of the process. */
+    struct syscall_stats *syscall_stats; /*!< Per-syscall accounting, or NULL
+                                              if not being kept. */
     /**@{*/
 #endif
 
@@ -152,10 +160,13 @@ extern long long ticks;
     Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/*! Number of timer ticks to give each thread. A tunable. */
+extern size_t thread_time_slice;
+
 void thread_init(void);
 void thread_start(void);
 
-void thread_tick(void);
+void thread_tick(bool user);
 void thread_print_stats(void);
 
 typedef void thread_func(void *aux);
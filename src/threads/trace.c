@@ -0,0 +1,162 @@
+/*! \file trace.c
+ *
+ * Kernel event tracing. Tracepoints throughout the kernel record events,
+ * each with a time stamp counter reading, the running thread's tid and up to
+ * three arguments, in a ring buffer which keeps the latest TRACE_RECORDS
+ * events. The kinds of events are fixed when the kernel is compiled, by
+ * enum trace_event and the table of names and formats below. At shutdown
+ * the events are printed in order on "Trace" lines, giving a timeline which
+ * aggregate counters cannot, and a process can read the latest events with
+ * the stats system call.
+ */
+
+#include "threads/trace.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/*! Pages of records. */
+#define TRACE_PAGES 32
+
+/*! Number of records kept. */
+#define TRACE_RECORDS (TRACE_PAGES * PGSIZE / sizeof(record_t))
+
+/*! Longest line trace_format() expects to write for one record. */
+#define TRACE_LINE_MAX 96
+
+/*! A recorded event. */
+typedef struct record {
+    uint64_t tsc;               /*!< Time stamp counter. */
+    tid_t tid;                  /*!< Running thread. */
+    enum trace_event event;     /*!< What happened. */
+    uint32_t args[3];           /*!< Arguments, as passed to TRACE(). */
+} record_t;
+
+/*! Names and argument formats of the events. Each format is given the three
+    arguments as 32-bit words, so pointers may be printed with %s or %p. */
+static const struct {
+    const char *name;
+    const char *format;
+} events[TRACE_EVENT_CNT] = {
+    [TRACE_SCHEDULE] = { "schedule", "tid %u to %u, status %u" },
+    [TRACE_PAGE_FAULT] = { "page-fault", "page %p from %s, write %u" },
+    [TRACE_EVICT] = { "evict", "page %p to %s" },
+    [TRACE_BLOCK_READ] = { "block-read", "%s sectors %u+%u" },
+    [TRACE_BLOCK_WRITE] = { "block-write", "%s sectors %u+%u" },
+    [TRACE_BLOCK_COMPLETE] = { "block-complete", "%s sectors %u+%u" },
+    [TRACE_CACHE_MISS] = { "cache-miss", "sector %u" },
+    [TRACE_CACHE_EVICT] = { "cache-evict", "sector %u" },
+    [TRACE_SYSCALL_ENTER] = { "syscall-enter", "%s" },
+    [TRACE_SYSCALL_EXIT] = { "syscall-exit", "%s returned %#x" },
+};
+
+bool trace_enabled;
+
+/*! Ring buffer of records, and the number of events recorded. The latest
+    record is at index (record_cnt - 1) % TRACE_RECORDS. */
+static record_t *records;
+static unsigned long long record_cnt;
+
+/*! Allocates the ring buffer, if tracing is enabled. Must be called after
+    palloc_init(). */
+void trace_init(void) {
+    if (!trace_enabled)
+        return;
+    records = palloc_get_multiple(0, TRACE_PAGES);
+    if (records == NULL) {
+        printf("trace: no memory for records, tracing disabled\n");
+        trace_enabled = false;
+    }
+}
+
+/*! Returns the tid of the thread whose stack we are on. Unlike
+    thread_current(), this works in the middle of a context switch, when the
+    thread is no longer marked as running. */
+static tid_t running_tid(void) {
+    uint32_t *esp;
+    asm ("mov %%esp, %0" : "=g" (esp));
+    return ((thread_t *) pg_round_down(esp))->tid;
+}
+
+/*! Records EVENT with arguments A, B and C. Use TRACE() rather than calling
+    this directly, so that nothing is done unless tracing is enabled. May be
+    called from interrupt handlers. */
+void trace_record(enum trace_event event, uint32_t a, uint32_t b,
+                  uint32_t c) {
+    ASSERT(event < TRACE_EVENT_CNT);
+    enum intr_level old_level = intr_disable();
+    if (records != NULL) {
+        record_t *r = &records[record_cnt++ % TRACE_RECORDS];
+        r->tsc = rdtsc();
+        r->tid = running_tid();
+        r->event = event;
+        r->args[0] = a;
+        r->args[1] = b;
+        r->args[2] = c;
+    }
+    intr_set_level(old_level);
+}
+
+/*! Formats record R into the SIZE bytes of BUF as one line, with its time
+    relative to START. Returns the length the line would have, as
+    snprintf(). */
+static int record_format(char *buf, size_t size, const record_t *r,
+                         uint64_t start) {
+    int len = snprintf(buf, size, "%12"PRIu64" %4d %-14s ", r->tsc - start,
+                       r->tid, events[r->event].name);
+    if (len < 0 || (size_t) len >= size)
+        return len;
+    len += snprintf(buf + len, size - len, events[r->event].format,
+                    r->args[0], r->args[1], r->args[2]);
+    if ((size_t) len + 1 < size)
+        len += snprintf(buf + len, size - len, "\n");
+    return len;
+}
+
+/*! Formats the latest events which fit, oldest first, into the SIZE bytes
+    of BUF, one line each. Times are in cycles since the first of them.
+    Returns the number of bytes written, not counting the null
+    terminator. */
+size_t trace_format(char *buf, size_t size) {
+    size_t len = 0;
+
+    if (size == 0)
+        return 0;
+    buf[0] = '\0';
+
+    /* Keep events from being recorded while we format. */
+    enum intr_level old_level = intr_disable();
+    unsigned long long end = record_cnt;
+    unsigned long long n = end < TRACE_RECORDS ? end : TRACE_RECORDS;
+    if (n > size / TRACE_LINE_MAX)
+        n = size / TRACE_LINE_MAX;
+    uint64_t start = n > 0 ? records[(end - n) % TRACE_RECORDS].tsc : 0;
+    for (unsigned long long i = end - n; i < end && len + 1 < size; i++)
+        len += record_format(buf + len, size - len,
+                             &records[i % TRACE_RECORDS], start);
+    intr_set_level(old_level);
+    return len < size ? len : size - 1;
+}
+
+/*! Prints the recorded events. Stops tracing, so that the events printed
+    are not overwritten meanwhile. */
+void trace_print_stats(void) {
+    if (records == NULL)
+        return;
+    trace_enabled = false;
+
+    unsigned long long n = record_cnt < TRACE_RECORDS ? record_cnt
+                                                      : TRACE_RECORDS;
+    printf("Trace: %llu events, %llu overwritten\n", record_cnt,
+           record_cnt - n);
+
+    char line[TRACE_LINE_MAX * 2];
+    uint64_t start = n > 0 ? records[(record_cnt - n) % TRACE_RECORDS].tsc : 0;
+    for (unsigned long long i = record_cnt - n; i < record_cnt; i++) {
+        record_format(line, sizeof line, &records[i % TRACE_RECORDS], start);
+        printf("Trace %s", line);
+    }
+}
@@ -0,0 +1,55 @@
+/*! \file trace.h
+ *
+ * Kernel event tracing.
+ */
+
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*! Traced events. Each is recorded with up to three 32-bit arguments, which
+    are described next to it and printed by its format in trace.c. */
+enum trace_event {
+    TRACE_SCHEDULE,         /*!< Switch from tid, to tid, old status. */
+    TRACE_PAGE_FAULT,       /*!< Loaded page, source string, was write. */
+    TRACE_EVICT,            /*!< Evicted page, destination string. */
+    TRACE_BLOCK_READ,       /*!< Read submitted: device name, first sector,
+                                 sector count. */
+    TRACE_BLOCK_WRITE,      /*!< Write submitted: device name, first sector,
+                                 sector count. */
+    TRACE_BLOCK_COMPLETE,   /*!< Device name, first sector, sector count. */
+    TRACE_CACHE_MISS,       /*!< Sector missed in the buffer cache. */
+    TRACE_CACHE_EVICT,      /*!< Sector evicted from the buffer cache. */
+    TRACE_SYSCALL_ENTER,    /*!< Syscall name. */
+    TRACE_SYSCALL_EXIT,     /*!< Syscall name, return value. */
+    TRACE_EVENT_CNT         /*!< Number of events. */
+};
+
+/*! Whether to trace, set by the -trace command-line option. */
+extern bool trace_enabled;
+
+/*! Records EVENT with arguments A, B and C, if tracing. Pointers, including
+    string literals, are passed as uintptr_t. */
+#define TRACE(EVENT, A, B, C)                                           \
+    do {                                                                \
+        if (trace_enabled)                                              \
+            trace_record((EVENT), (uint32_t) (A), (uint32_t) (B),       \
+                         (uint32_t) (C));                               \
+    } while (0)
+
+/*! Returns the time stamp counter. */
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+void trace_init(void);
+void trace_record(enum trace_event, uint32_t a, uint32_t b, uint32_t c);
+size_t trace_format(char *buf, size_t size);
+void trace_print_stats(void);
+
+#endif /* threads/trace.h */
@@ -0,0 +1,137 @@
+/*! \file tune.c
+ *
+ * Registry of tunable performance parameters. Each tunable is a size_t
+ * variable owned by the module it tunes, which reads it where it would
+ * otherwise have used a compile-time constant. Tunables are set at boot
+ * with "-tune NAME=VALUE" on the kernel command line, and those which are
+ * safe to change while the kernel runs may also be set by user programs
+ * with the tune system call. Values outside a tunable's range are refused.
+ */
+
+#include "threads/tune.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/syscall.h"
+#endif
+#ifdef FILESYS
+#include "filesys/fsdisk.h"
+#endif
+#ifdef VM
+#include "vm/frametbl.h"
+#include "vm/swapcache.h"
+#endif
+
+/*! A tunable. */
+typedef struct tunable {
+    const char *name;           /*!< Name, as MODULE.PARAMETER. */
+    size_t *value;              /*!< The variable tuned. */
+    size_t min, max;            /*!< Range of allowed values. */
+    bool runtime;               /*!< May be set after boot. */
+    const char *desc;           /*!< What it does. */
+} tunable_t;
+
+/*! The tunables. */
+static const tunable_t tunables[] = {
+    { "sched.time_slice", &thread_time_slice, 1, 1000, true,
+      "timer ticks each thread runs before it is preempted" },
+#ifdef USERPROG
+    { "console.max_print", &syscall_max_print, 1, 65536, true,
+      "most bytes written to the console at once" },
+#endif
+#ifdef FILESYS
+    { "cache.sectors", &fs_cache_sectors, 16, 8192, false,
+      "sectors in the file system buffer cache" },
+    { "cache.read_ahead", &fs_read_ahead_size, 1, FS_READ_AHEAD_MAX, false,
+      "sectors which may be queued for read-ahead" },
+    { "cache.flush_period", &fs_flush_period, 1, 60 * TIMER_FREQ, true,
+      "timer ticks between write-behind flushes" },
+#endif
+#ifdef VM
+    { "vm.age_blocks", &frametbl_age_blocks, 1, 1024, true,
+      "blocks the frame table is split into for aging" },
+    { "vm.age_freq", &frametbl_age_freq, 1, 1000, true,
+      "user ticks between frame aging passes" },
+    { "vm.age_budget", &frametbl_age_budget, 1, 1 << 20, true,
+      "most frames aged by one aging pass" },
+    { "vm.swapcache_pages", &swapcache_pages, 0, 4096, false,
+      "pages of memory for the compressed swap cache" },
+#endif
+};
+
+#define TUNABLE_CNT (sizeof tunables / sizeof *tunables)
+
+/*! Parses the decimal number S into *VALUE. Returns false if S is not a
+    number or does not fit in a size_t. */
+static bool parse_size(const char *s, size_t *value) {
+    size_t v = 0;
+
+    if (*s == '\0')
+        return false;
+    for (; *s != '\0'; s++) {
+        if (*s < '0' || *s > '9' || v > (SIZE_MAX - (*s - '0')) / 10)
+            return false;
+        v = v * 10 + (*s - '0');
+    }
+    *value = v;
+    return true;
+}
+
+/*! Applies SETTING, of the form NAME=VALUE. BOOT is true while the kernel
+    command line is being parsed, and false afterward, when only tunables
+    which are safe to change at runtime may be set. Returns true if
+    successful, false if NAME is not a tunable which may be set now or VALUE
+    is not a number in its range. */
+bool tune_set(const char *setting, bool boot) {
+    const char *eq = strchr(setting, '=');
+    size_t value;
+
+    if (eq == NULL || !parse_size(eq + 1, &value))
+        return false;
+    for (size_t i = 0; i < TUNABLE_CNT; i++) {
+        const tunable_t *t = &tunables[i];
+        if (strlen(t->name) == (size_t) (eq - setting)
+            && !strncmp(t->name, setting, eq - setting)) {
+            if ((!boot && !t->runtime) || value < t->min || value > t->max)
+                return false;
+            *t->value = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*! Formats a line describing tunable T into the SIZE bytes of BUF, as
+    snprintf(). */
+static int tunable_format(const tunable_t *t, char *buf, size_t size) {
+    return snprintf(buf, size, "%s=%zu (%zu to %zu%s): %s\n", t->name,
+                    *t->value, t->min, t->max, t->runtime ? "" : ", at boot",
+                    t->desc);
+}
+
+/*! Formats the tunables and their values into the SIZE bytes of BUF, one
+    per line. Returns the number of bytes written, not counting the null
+    terminator. */
+size_t tune_format(char *buf, size_t size) {
+    size_t len = 0;
+
+    if (size == 0)
+        return 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < TUNABLE_CNT && len + 1 < size; i++)
+        len += tunable_format(&tunables[i], buf + len, size - len);
+    return len < size ? len : size - 1;
+}
+
+/*! Prints the tunables and their values, one per line. */
+void tune_print(void) {
+    char line[160];
+
+    for (size_t i = 0; i < TUNABLE_CNT; i++) {
+        tunable_format(&tunables[i], line, sizeof line);
+        printf("  %s", line);
+    }
+}
@@ -0,0 +1,19 @@
+/*! \file tune.h
+ *
+ * Registry of tunable performance parameters.
+ */
+
+#ifndef THREADS_TUNE_H
+#define THREADS_TUNE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*! Longest NAME=VALUE setting accepted from user programs. */
+#define TUNE_MAX_LEN 64
+
+bool tune_set(const char *setting, bool boot);
+size_t tune_format(char *buf, size_t size);
+void tune_print(void);
+
+#endif /* threads/tune.h */
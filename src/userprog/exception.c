@@ -159,24 +159,18 @@ static void page_fault(intr_frame_t *f) {
     if (vm_page_is_mapped(pt, page) && // page exists for user
         (vm_page_is_writeable(pt, page) || !write)) { // read-only page
         // this is a user page that needs to be swapped in
-        frame = vm_load_page(pt, page);
+        frame = vm_load_page(pt, page, write);
     } else if (is_stack_growth(esp, fault_addr)) {
         // this is an attempt at stack growth which should be allowed
         if (page < PHYS_BASE - MAX_USER_STACK) goto exit;
-        frame = vm_set_load_stack_page(pt, page);
-        for (page += PGSIZE; !vm_page_is_stack(pt, page); page += PGSIZE) {
-            if (!vm_page_is_mappable(pt, page) || 
-                !vm_set_stack_page(pt, page)) {
-                frame = NULL;
-                goto exit;
-            }
-        }
+        frame = vm_grow_stack(pt, page);
     }
 
     exit:
     if (frame != NULL) {
         // we resolved the page fault by swapping in the desired page
-        frametbl_unpin_frame(frame);
+        cur->usage.page_faults++;
+        if (frame != vm_zero_frame()) frametbl_unpin_frame(frame);
         return;
     }
 
@@ -177,7 +177,7 @@ void filemap_foreach(file_map_t *fm, fm_file_action_func file_action,
         }
     }
     for (list_elem_t *e = list_begin(&fm->overflow);
-         e != list_end(&fm->overflow); list_next(e)) {
+         e != list_end(&fm->overflow); e = list_next(e)) {
         file_elem_t *fe = list_entry(e, file_elem_t, elem);
         if (fe->is_dir && dir_action != NULL) {
             dir_action((dir_t *) fe->f, aux);
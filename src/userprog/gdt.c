@@ -39,7 +39,8 @@ static uint64_t make_gdtr_operand(uint16_t limit, void *base);
 void gdt_init(void) {
     uint64_t gdtr_operand;
 
-    /* Initialize GDT. */
+    /* Initialize GDT.  SYSEXIT requires the user code and data segments
+       to follow the kernel code and data segments in this order. */
     gdt[SEL_NULL / sizeof *gdt] = 0;
     gdt[SEL_KCSEG / sizeof *gdt] = make_code_desc(0);
     gdt[SEL_KDSEG / sizeof *gdt] = make_data_desc(0);
@@ -0,0 +1,61 @@
+/*! \file kdata.c
+ *
+ * The kernel data page is a single page holding a struct kdata (see
+ * lib/kdata.h), mapped read-only at KDATA_ADDR in every user process. The
+ * timer interrupt rewrites it on every tick, bracketing each update with
+ * increments of its sequence number, so that user programs can take a
+ * consistent snapshot of the 64-bit tick count with plain loads.
+ *
+ * The page is not a region of the supplemental page table, so it is never
+ * evicted, and the system calls do not accept buffers inside it.
+ */
+
+#include "userprog/kdata.h"
+#include <debug.h>
+#include <kdata.h>
+#include "devices/rtc.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+
+/*! The kernel data page, or NULL before kdata_init(). */
+static struct kdata *kdata;
+
+/*! Allocates and fills in the kernel data page. */
+void kdata_init(void) {
+    struct kdata *kd = palloc_get_page(PAL_ZERO);
+    if (kd == NULL) {
+        PANIC("Could not allocate the kernel data page.");
+    }
+    kd->ticks_per_sec = TIMER_FREQ;
+    kd->boot_time = rtc_get_time();
+
+    enum intr_level old_level = intr_disable();
+    kdata = kd;
+    kdata_update();
+    intr_set_level(old_level);
+}
+
+/*! Copies the tick count and load average into the kernel data page. Called
+    by thread_tick() with interrupts off, so there is only one writer. */
+void kdata_update(void) {
+    ASSERT(intr_get_level() == INTR_OFF);
+    if (kdata == NULL) return;
+
+    kdata->seq++;
+    barrier();
+    kdata->ticks = timer_ticks();
+    kdata->load_avg = thread_get_load_avg();
+    barrier();
+    kdata->seq++;
+}
+
+/*! Maps the kernel data page read-only into page directory PD. Returns
+    false if memory for a page table is not available. */
+bool kdata_map(uint32_t *pd) {
+    ASSERT(kdata != NULL);
+    return pagedir_set_page(pd, (void *) KDATA_ADDR, kdata, false);
+}
@@ -0,0 +1,16 @@
+/*! \file kdata.h
+ *
+ * Maintains the kernel data page shared read-only with user processes.
+ */
+
+#ifndef USERPROG_KDATA_H
+#define USERPROG_KDATA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void kdata_init(void);
+void kdata_update(void);
+bool kdata_map(uint32_t *pd);
+
+#endif /* userprog/kdata.h */
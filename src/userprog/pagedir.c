@@ -13,7 +13,7 @@
 #include "threads/palloc.h"
 
 static uint32_t *active_pd(void);
-static void invalidate_pagedir(uint32_t *);
+static void invalidate_page(uint32_t *, const void *);
 
 /*! Creates a new page directory that has mappings for kernel virtual
     addresses, but none for user virtual addresses.  Returns the new page
@@ -130,7 +130,7 @@ void pagedir_clear_page(uint32_t *pd, void *upage) {
     pte = lookup_page(pd, upage, false);
     if (pte != NULL && (*pte & PTE_P) != 0) {
         *pte &= ~PTE_P;
-        invalidate_pagedir(pd);
+        invalidate_page(pd, upage);
     }
 }
 
@@ -151,7 +151,7 @@ void pagedir_set_dirty(uint32_t *pd, const void *vpage, bool dirty) {
         }
         else {
             *pte &= ~(uint32_t) PTE_D;
-            invalidate_pagedir(pd);
+            invalidate_page(pd, vpage);
         }
     }
 }
@@ -174,11 +174,36 @@ void pagedir_set_accessed(uint32_t *pd, const void *vpage, bool accessed) {
         }
         else {
             *pte &= ~(uint32_t) PTE_A; 
-            invalidate_pagedir(pd);
+            invalidate_page(pd, vpage);
         }
     }
 }
 
+/*! Clears the accessed bit in the PTE for virtual page VPAGE in PD and
+    returns its previous value.
+
+    Unlike pagedir_set_accessed(), this does not invalidate the TLB, so while
+    the CPU still caches the old translation it does not set the bit again.
+    That is harmless, because the CPU never needs the bit, but callers which
+    clear many bits at once should call pagedir_flush_tlb() when they are
+    done, so that later accesses are seen. */
+bool pagedir_reset_accessed(uint32_t *pd, const void *vpage) {
+    uint32_t *pte = lookup_page(pd, vpage, false);
+    if (pte == NULL || (*pte & PTE_A) == 0) {
+        return false;
+    }
+    *pte &= ~(uint32_t) PTE_A;
+    return true;
+}
+
+/*! Flushes the translations of user pages from the TLB. Kernel pages are
+    global, so they stay cached. */
+void pagedir_flush_tlb(void) {
+    /* Reloading CR3 drops all non-global entries.  See [IA32-v3a] 3.12
+       "Translation Lookaside Buffers (TLBs)". */
+    pagedir_activate(active_pd());
+}
+
 /*! Loads page directory PD into the CPU's page directory base register. */
 void pagedir_activate(uint32_t *pd) {
     if (pd == NULL)
@@ -203,16 +228,16 @@ static uint32_t * active_pd(void) {
 
 /*! Some page table changes can cause the CPU's translation lookaside buffer
     (TLB) to become out-of-sync with the page table.  When this happens, we
-    have to "invalidate" the TLB by re-activating it.
+    have to "invalidate" the stale entry.
 
-    This function invalidates the TLB if PD is the active page directory.
-    (If PD is not active then its entries are not in the TLB, so there is no
-    need to invalidate anything.) */
-static void invalidate_pagedir(uint32_t *pd) {
+    This function invalidates the TLB entry for VADDR if PD is the active page
+    directory.  (If PD is not active then its entries are not in the TLB, so
+    there is no need to invalidate anything.)  Only the one entry is dropped,
+    rather than the whole TLB. */
+static void invalidate_page(uint32_t *pd, const void *vaddr) {
     if (active_pd() == pd) {
-        /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-           "Translation Lookaside Buffers (TLBs)". */
-        pagedir_activate(pd);
+        /* See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+        asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
     }
 }
 
@@ -13,6 +13,8 @@ bool pagedir_is_dirty(uint32_t *pd, const void *upage);
 void pagedir_set_dirty(uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed(uint32_t *pd, const void *upage);
 void pagedir_set_accessed(uint32_t *pd, const void *upage, bool accessed);
+bool pagedir_reset_accessed(uint32_t *pd, const void *upage);
+void pagedir_flush_tlb(void);
 void pagedir_activate(uint32_t *pd);
 
 #endif /* userprog/pagedir.h */
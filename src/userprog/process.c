@@ -6,8 +6,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include "userprog/gdt.h"
+#include "userprog/kdata.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
+#include "userprog/syscall.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -158,6 +160,7 @@ void process_init(thread_t *t) {
     // cleans up.
     t->handle = NULL;
     t->stack_pointer = NULL;
+    t->syscall_stats = NULL;
 }
 
 /*! A thread function that loads a user process and starts it running. */
@@ -244,6 +247,7 @@ void process_cleanup() {
     sup_pagetable_t *pt = &cur->pt;
     if (!sup_pt_is_kernel(pt)) {
         printf("%s: exit(%d)\n", thread_name(), cur->exit_code);
+        syscall_exit();
 
         /* Close all file system accesses currently open. */
         close_all_fds();
@@ -376,6 +380,7 @@ bool load(const char *command, void (**eip) (void), void **esp) {
 
     /* Allocate and activate page directory. */
     if (!sup_pt_create(&t->pt)) goto done;
+    if (!kdata_map(t->pt.pd)) goto done;
     process_activate();
 
     /* Start file descriptor map. */
@@ -543,30 +548,11 @@ static bool load_segment(file_t *file, off_t f_ofs, uint8_t *upage,
     ASSERT(f_ofs % PGSIZE == 0);
     sup_pagetable_t *pt = &thread_current()->pt;
 
-    while (read_bytes > 0 || zero_bytes > 0) {
-        /* Calculate how to fill this page.
-           We will read PAGE_READ_BYTES bytes from FILE
-           and zero the final PAGE_ZERO_BYTES bytes. */
-        size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-        size_t page_zero_bytes = PGSIZE - page_read_bytes;
-        if (page_read_bytes > 0) {
-            if (!vm_set_page(pt, upage, MAP_WRITE * writable,
-                                file, f_ofs, page_read_bytes)) {
-                return false;
-            }
-        } else {
-            if (!vm_set_page(pt, upage, MAP_WRITE * writable, NULL, 0, 0)) {
-                return false;
-            }
-        }
-
-        /* Advance. */
-        read_bytes -= page_read_bytes;
-        zero_bytes -= page_zero_bytes;
-        upage += PGSIZE;
-        f_ofs += PGSIZE;
-    }
-    return true;
+    /* The first READ_BYTES bytes are read from FILE and the final
+       ZERO_BYTES bytes are zeroed, all in one region. */
+    return vm_map_region(pt, upage, (read_bytes + zero_bytes) / PGSIZE,
+                         MAP_WRITE * writable, read_bytes > 0 ? file : NULL,
+                         f_ofs, read_bytes);
 }
 
 static bool cleanup_stack_page(void **esp, uint8_t *kpage, char** argv, char** argv_addresses){
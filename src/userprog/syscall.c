@@ -1,8 +1,17 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <inttypes.h>
+#include <kdata.h>
+#include <round.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tune.h"
 #include "threads/vaddr.h"
 #include "userprog/exception.h"
 #include "devices/shutdown.h"
@@ -10,6 +19,9 @@
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
 #include "filesys/file.h"
+#include "devices/block.h"
+#include "devices/ide.h"
+#include "devices/timer.h"
 #include "devices/input.h"
 #include "vm/mappings.h"
 
@@ -22,8 +34,57 @@
 /*! Returned by some syscalls on error. */
 #define SC_ERR ((uint32_t) -1)
 
-/*! Maximum bytes which can be printed at once before the buffer is broken up.*/
-static const uint32_t MAX_PRINT = 1024;
+/*! Maximum bytes which can be printed at once before the buffer is broken up.
+    A tunable. */
+size_t syscall_max_print = 1024;
+
+/*! Number of system calls, one more than the last syscall number. */
+#define SYS_CNT (SYS_GETRUSAGE + 1)
+
+/*! Latency histogram buckets. Bucket 0 counts calls which took fewer than
+    2^(HIST_SHIFT + 1) cycles, bucket I > 0 those which took from 2^(I +
+    HIST_SHIFT) up to 2^(I + HIST_SHIFT + 1) cycles, except that the last
+    bucket has no upper bound. */
+#define HIST_BUCKETS 16
+#define HIST_SHIFT 10
+
+/*! Accounting for one system call. */
+typedef struct {
+    uint32_t calls;                 /*!< Times invoked. */
+    uint64_t cycles;                /*!< Total cycles spent in completed
+                                         calls. */
+    uint64_t bytes;                 /*!< Bytes moved, for reads and writes. */
+    uint32_t hist[HIST_BUCKETS];    /*!< Latency histogram, in cycles. */
+} syscall_count_t;
+
+/*! Accounting for each system call made by one process, or by all of
+    them. Calls which do not return, such as exit, are counted but not
+    timed. */
+struct syscall_stats {
+    syscall_count_t counts[SYS_CNT];
+};
+
+/*! Names of the system calls, for statistics. */
+static const char *syscall_names[SYS_CNT] = {
+    [SYS_HALT] = "halt", [SYS_EXIT] = "exit", [SYS_EXEC] = "exec",
+    [SYS_WAIT] = "wait", [SYS_CREATE] = "create", [SYS_REMOVE] = "remove",
+    [SYS_OPEN] = "open", [SYS_FILESIZE] = "filesize", [SYS_READ] = "read",
+    [SYS_WRITE] = "write", [SYS_SEEK] = "seek", [SYS_TELL] = "tell",
+    [SYS_CLOSE] = "close", [SYS_MMAP] = "mmap", [SYS_MUNMAP] = "munmap",
+    [SYS_CHDIR] = "chdir", [SYS_MKDIR] = "mkdir", [SYS_READDIR] = "readdir",
+    [SYS_ISDIR] = "isdir", [SYS_INUMBER] = "inumber", [SYS_STATS] = "stats",
+    [SYS_TUNE] = "tune", [SYS_GETTIME] = "gettime",
+    [SYS_GETRUSAGE] = "getrusage",
+};
+
+bool syscall_stats_enabled;
+
+/*! System calls made by all processes. Updated with interrupts off. */
+static struct syscall_stats syscall_totals;
+
+/*! Error code of the interrupt frames built by sysenter_entry(), whose
+    system calls pass their number and arguments in registers. */
+#define SYSENTER_FRAME 1
 
 static void syscall_handler(intr_frame_t *);
 
@@ -95,12 +156,21 @@ static void set_return(intr_frame_t *f, uint32_t val) {
 /*! Gets the number of the system call which was invoked.
     Returns PF_ERR on segfault or other invalid access. */
 static uint32_t get_syscall_num(intr_frame_t *f) {
+    if (f->error_code == SYSENTER_FRAME) return f->eax;
     return get_user32((uint8_t *) f->esp);
 }
 
 /*! Gets the Nth argument to the syscall which was invoked.
     Returns PF_ERR on segfault or other invalid access. */
 static uint32_t get_arg(intr_frame_t *f, size_t n) {
+    if (f->error_code == SYSENTER_FRAME) {
+        switch (n) {
+            case 0: return f->ebx;
+            case 1: return f->esi;
+            case 2: return f->edi;
+            default: return PF_ERR;
+        }
+    }
     uint8_t *addr = ((uint8_t *) f->esp) +
         WORD_SIZE * (n + 1); // First is syscall num
     return get_user32(addr);
@@ -114,12 +184,22 @@ static bool test_write(uint8_t *uaddr) {
     return set_user(uaddr, get_user8(uaddr));
 }
 
+/*! Returns true if the SIZE bytes at UADDR overlap the kernel data page.
+    That page is mapped outside of the supplemental page table, so it cannot
+    be pinned and system calls may not use it as a buffer. */
+static bool overlaps_kdata(const void *uaddr, uint32_t size) {
+    return (uintptr_t) uaddr < KDATA_ADDR + PGSIZE
+        && (uintptr_t) uaddr + size > KDATA_ADDR;
+}
+
 /*! Verifies that a buffer pointer is a valid one in user space, by attempting
     to read from it and each subsequent page until SIZE.
     Returns true if the entire buffer is valid, false otherwise. */
 static bool verify_buffer(char *buffer, uint32_t size, bool write) {
     bool (*test_byte)(uint8_t *uaddr) = write ? test_write : test_read;
 
+    if (overlaps_kdata(buffer, size)) return false;
+
     // Verify a pointer on each subsequent page
     uint8_t *end = (uint8_t *) buffer + size;
     uint8_t *start = (uint8_t *) buffer;
@@ -130,15 +210,16 @@ static bool verify_buffer(char *buffer, uint32_t size, bool write) {
 }
 
 /*! Verifies a string which is in user space is valid to access. Returns
-    its length (ie: until the first null terminator), or SC_ERR on
-    page fault or if its length is > MAX_SIZE. */
+    its length (ie: until the first null terminator), or SC_ERR if its length
+    is > MAX_SIZE. Terminates the process on page fault or if the string lies
+    in the kernel data page. */
 static uint32_t valid_str_len(char *str, const uint32_t max_size) {
     for (uint32_t i = 0; i <= max_size; i++) {
         char *ptr = str + i;
 
         // Try calling `get` on each character in the string
         uint32_t letter = get_user8((uint8_t *) ptr);
-        if (letter == PF_ERR) {
+        if (letter == PF_ERR || overlaps_kdata(ptr, 1)) {
             process_terminate();
         } else if ((char) letter == '\0') {
             return i;
@@ -149,22 +230,28 @@ static uint32_t valid_str_len(char *str, const uint32_t max_size) {
 }
 
 /*! Pins the given buffer, ensuring it will not be swapped out under the kernel.
-    Assumes it is valid. */
+    Assumes it is valid. Terminates the process if memory to load it is not
+    available. */
 static void pin_buffer(void *buffer, uint32_t size) {
     sup_pagetable_t *pt = &thread_current()->pt;
     uintptr_t start = pg_no(buffer);
     uintptr_t end = pg_no(buffer + size - 1);
     size_t n = end - start + 1;
-    vm_pin_pages(pt, (void *) (start * PGSIZE), n);
+    if (!vm_pin_pages(pt, (void *) (start * PGSIZE), n)) {
+        process_terminate();
+    }
 }
 /*! Pins the given str, ensuring it will not be swapped out under the kernel.
-    Assumes it is valid. */
+    Assumes it is valid. Terminates the process if memory to load it is not
+    available. */
 static void pin_str(char *str) {
     sup_pagetable_t *pt = &thread_current()->pt;
     uintptr_t start = pg_no(str);
     uintptr_t end = pg_no(strchr(str, '\0'));
     size_t n = end - start + 1;
-    vm_pin_pages(pt, (void *) (start * PGSIZE), n);
+    if (!vm_pin_pages(pt, (void *) (start * PGSIZE), n)) {
+        process_terminate();
+    }
 }
 /*! Unpins the given buffer, allowing it to be swapped again. Should have been
     passed to pin_buffer before. */
@@ -302,12 +389,13 @@ static uint32_t sys_write(uint32_t fd, char *buffer, uint32_t size) {
 
     if (fd == STDOUT_FILENO) {
         // Number of completely full buffers to print to the console
-        uint32_t num_long = size / MAX_PRINT;
+        uint32_t max_print = syscall_max_print;
+        uint32_t num_long = size / max_print;
         for (uint32_t i = 0; i < num_long; i++) {
-            putbuf(buffer, MAX_PRINT);
-            buffer += MAX_PRINT;
+            putbuf(buffer, max_print);
+            buffer += max_print;
         }
-        putbuf(buffer, size - num_long * MAX_PRINT);
+        putbuf(buffer, size - num_long * max_print);
         return size; // putbuf always succeeds
     } else {
         bool is_dir;
@@ -381,17 +469,10 @@ static uintptr_t sys_mmap(uint32_t fd, void *addr) {
 
     if (addr + len >= cur->stack_pointer) return SC_ERR;
 
-    for (void *upage = addr; upage < addr + len; upage += PGSIZE) {
-        if (!vm_page_is_mappable(pt, upage)) return SC_ERR;
-    }
-
-    for (void *upage = addr; upage < addr + len; upage += PGSIZE) {
-        uint32_t flags = (upage == addr) * MAP_START | MAP_FWRITE | MAP_WRITE;
-        size_t remaining = len - (upage - addr);
-        size_t size = remaining < PGSIZE ? remaining : PGSIZE;
-        if (!vm_set_page(pt, upage, flags, (file_t *) file, upage - addr, size)) {
-            return SC_ERR;
-        }
+    if (!vm_map_region(pt, addr, DIV_ROUND_UP(len, PGSIZE),
+                       MAP_START | MAP_FWRITE | MAP_WRITE, (file_t *) file,
+                       0, len)) {
+        return SC_ERR;
     }
 
     // Like real mmap, we simply use the address as the mapid_t
@@ -403,12 +484,7 @@ static void sys_munmap(uintptr_t mapping) {
     void *first = (void *) mapping;
     sup_pagetable_t *pt = &thread_current()->pt;
 
-    if (!vm_page_is_mapping_start(pt, first)) process_terminate();
-    void *last = vm_page_get_mapping_end(pt, first);
-
-    for (void *upage = first; upage <= last; upage += PGSIZE) {
-        vm_clear_page(pt, upage);
-    }
+    if (!vm_unmap_region(pt, first)) process_terminate();
 }
 
 /*! Invoked by the syscall `bool mkdir (const char *dir)` */
@@ -475,21 +551,238 @@ static uint32_t sys_inumber(uint32_t fd){
         return inode_get_inumber(dir_get_inode((dir_t *) dir_or_file));
     }
     else{
-        return inode_get_inumber(file_get_inode((file_t *) dir_or_file));
+        // Virtual files have no inode, and so no inode number.
+        inode_t *inode = file_get_inode((file_t *) dir_or_file);
+        if (inode != NULL) return inode_get_inumber(inode);
     }
     return SC_ERR;
 }
 
+/*! Returns the histogram bucket for a call which took CYCLES. */
+static size_t hist_bucket(uint64_t cycles) {
+    size_t b = 0;
+    while (b < HIST_BUCKETS - 1 && cycles >= (2ULL << (b + HIST_SHIFT))) {
+        b++;
+    }
+    return b;
+}
+
+/*! Returns the current process's syscall accounting, allocating it if the
+    process has none yet. Returns NULL if memory is not available, in which
+    case the process's calls go uncounted. */
+static struct syscall_stats *process_syscall_stats(void) {
+    thread_t *cur = thread_current();
+    if (cur->syscall_stats == NULL) {
+        cur->syscall_stats = calloc(1, sizeof *cur->syscall_stats);
+    }
+    return cur->syscall_stats;
+}
+
+/*! Counts a call to syscall NUM by the current process. A process only
+    keeps its own accounting, which takes most of a page, if -scstats was
+    given or once it has asked for it; the totals are always kept. */
+static void count_call(uint32_t num) {
+    struct syscall_stats *stats = syscall_stats_enabled
+        ? process_syscall_stats() : thread_current()->syscall_stats;
+    if (stats != NULL) stats->counts[num].calls++;
+
+    enum intr_level old_level = intr_disable();
+    syscall_totals.counts[num].calls++;
+    intr_set_level(old_level);
+}
+
+/*! Adds a completed call to syscall NUM which took CYCLES and moved BYTES to
+    the current process's accounting and the totals. */
+static void count_return(uint32_t num, uint64_t cycles, uint32_t bytes) {
+    struct syscall_stats *stats = thread_current()->syscall_stats;
+    size_t b = hist_bucket(cycles);
+    if (stats != NULL) {
+        syscall_count_t *c = &stats->counts[num];
+        c->cycles += cycles;
+        c->bytes += bytes;
+        c->hist[b]++;
+    }
+
+    enum intr_level old_level = intr_disable();
+    syscall_count_t *c = &syscall_totals.counts[num];
+    c->cycles += cycles;
+    c->bytes += bytes;
+    c->hist[b]++;
+    intr_set_level(old_level);
+}
+
+/*! Formats the accounting for syscalls in STATS which have been called, one
+    per line with each line preceded by PREFIX, into the SIZE bytes of BUF.
+    Returns the number of bytes written, not counting the null terminator. */
+static size_t stats_format(char *buf, size_t size, const char *prefix,
+                           const struct syscall_stats *stats) {
+    size_t len = 0;
+
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    for (size_t num = 0; num < SYS_CNT && len + 1 < size; num++) {
+        const syscall_count_t *c = &stats->counts[num];
+        if (c->calls == 0) continue;
+
+        uint32_t timed = 0;
+        for (size_t b = 0; b < HIST_BUCKETS; b++) timed += c->hist[b];
+        len += snprintf(buf + len, size - len, "%s%-8s %8"PRIu32" calls "
+                        "%12"PRIu64" cycles (%"PRIu64" avg)",
+                        prefix, syscall_names[num], c->calls, c->cycles,
+                        timed > 0 ? c->cycles / timed : 0);
+        if (c->bytes > 0 && len + 1 < size) {
+            len += snprintf(buf + len, size - len, " %"PRIu64" bytes",
+                            c->bytes);
+        }
+        for (size_t b = 0; b < HIST_BUCKETS && len + 1 < size; b++) {
+            if (c->hist[b] == 0) continue;
+            bool last = b == HIST_BUCKETS - 1;
+            len += snprintf(buf + len, size - len, " %s2^%zu:%"PRIu32,
+                            last ? ">=" : "<", b + HIST_SHIFT + !last,
+                            c->hist[b]);
+        }
+        if (len + 1 < size) len += snprintf(buf + len, size - len, "\n");
+    }
+    return len < size ? len : size - 1;
+}
+
+/*! Formats the current process's syscall accounting into the SIZE bytes of
+    BUF, one line per syscall it has made. Without -scstats, a process's
+    syscalls are only counted from the first time it asks for this. Returns
+    the number of bytes written, not counting the null terminator. */
+size_t syscall_stats_format(char *buf, size_t size) {
+    struct syscall_stats *stats = process_syscall_stats();
+    if (stats == NULL) {
+        if (size > 0) buf[0] = '\0';
+        return 0;
+    }
+    return stats_format(buf, size, "", stats);
+}
+
+/*! Prints the current process's syscall accounting if that was asked for,
+    and frees it. Called when a user process exits. */
+void syscall_exit(void) {
+    thread_t *cur = thread_current();
+    if (cur->syscall_stats == NULL) return;
+
+    if (syscall_stats_enabled) {
+        char *page = palloc_get_page(0);
+        if (page != NULL) {
+            char prefix[32];
+            snprintf(prefix, sizeof prefix, "%s: syscall ", thread_name());
+            stats_format(page, PGSIZE, prefix, cur->syscall_stats);
+            printf("%s", page);
+            palloc_free_page(page);
+        }
+    }
+    free(cur->syscall_stats);
+    cur->syscall_stats = NULL;
+}
+
+/*! Prints the syscall accounting of all processes, if that was asked
+    for. */
+void syscall_print_stats(void) {
+    if (!syscall_stats_enabled) return;
+
+    char *page = palloc_get_page(0);
+    if (page == NULL) return;
+    stats_format(page, PGSIZE, "Syscall ", &syscall_totals);
+    printf("%s", page);
+    palloc_free_page(page);
+}
+
+/*! Invoked by the syscall `int stats (int kind, char *buffer, unsigned size)`.
+    Formats the statistics of the given kind as text into the buffer, which
+    is null-terminated, and returns the length of the text. */
+static uint32_t sys_stats(uint32_t kind, char *buffer, uint32_t size) {
+    size_t (*format)(char *, size_t);
+
+    if (!verify_buffer(buffer, size, true)) {
+        process_terminate();
+    }
+
+    switch (kind) {
+#ifdef LOCK_PROFILE
+        case STATS_LOCKS: format = lock_stats_format; break;
+#endif
+        case STATS_SYSCALLS: format = syscall_stats_format; break;
+        case STATS_TRACE: format = trace_format; break;
+        case STATS_BLOCK: format = block_stats_format; break;
+        case STATS_IDE: format = ide_stats_format; break;
+        case STATS_TUNABLES: format = tune_format; break;
+        default: return SC_ERR;
+    }
+    if (size == 0) return SC_ERR;
+
+    char *page = palloc_get_page(0);
+    if (page == NULL) return SC_ERR;
+    size_t len = format(page, PGSIZE);
+    if (len >= size) len = size - 1;
+    page[len] = '\0';
+
+    pin_buffer(buffer, len + 1);
+    memcpy(buffer, page, len + 1);
+    unpin_buffer(buffer, len + 1);
+    palloc_free_page(page);
+
+    return len;
+}
+
+/*! Invoked by the syscall `bool tune (const char *setting)`. Sets the
+    tunable named in SETTING, of the form NAME=VALUE, if it may be changed
+    at runtime and VALUE is in its range. */
+static bool sys_tune(char *setting) {
+    char copy[TUNE_MAX_LEN + 1];
 
+    if (valid_str_len(setting, TUNE_MAX_LEN) == SC_ERR) return false;
+    pin_str(setting);
+    strlcpy(copy, setting, sizeof copy);
+    unpin_str(setting);
+
+    return tune_set(copy, false);
+}
+
+/*! Invoked by the syscall `int gettime (void)`. Returns the number of
+    milliseconds since the kernel booted, to the resolution of a timer tick. */
+static uint32_t sys_gettime(void) {
+    return timer_ticks() * 1000 / TIMER_FREQ;
+}
+
+/*! Invoked by the syscall `bool getrusage (struct rusage *usage)`. Copies
+    the resources the process has used into USAGE. */
+static bool sys_getrusage(struct rusage *usage) {
+    if (!verify_buffer((char *) usage, sizeof *usage, true)) {
+        process_terminate();
+    }
+
+    /* The timer updates the usage from interrupt context. */
+    enum intr_level old_level = intr_disable();
+    struct rusage copy = thread_current()->usage;
+    intr_set_level(old_level);
+
+    pin_buffer(usage, sizeof *usage);
+    *usage = copy;
+    unpin_buffer(usage, sizeof *usage);
+    return true;
+}
+
+/*! Handler for system calls made with SYSENTER, called by
+    sysenter_entry(). */
+void syscall_fast_handler(intr_frame_t *f) {
+    syscall_handler(f);
+}
 
 /*! Registered handler for system calls. */
 static void syscall_handler(intr_frame_t *f) {
     thread_current()->stack_pointer = f->esp;
 
     uint32_t num = get_syscall_num(f);
-    if (num == PF_ERR) {
+    if (num == PF_ERR || num >= SYS_CNT) {
         process_terminate();
     }
+    count_call(num);
+    TRACE(TRACE_SYSCALL_ENTER, syscall_names[num], 0, 0);
+    uint64_t start = rdtsc();
 
     /*! Macros to assist with interfacing with a syscall.
         All assume that an `intr_frame_t*` named `f` is present in the scope,
@@ -520,6 +813,10 @@ static void syscall_handler(intr_frame_t *f) {
         case SYS_ISDIR: RET(sys_isdir(ARG0)); break;
         case SYS_READDIR: RET(sys_readdir(ARG0, (char *) ARG1)); break;
         case SYS_INUMBER: RET(sys_inumber(ARG0)); break;
+        case SYS_STATS: RET(sys_stats(ARG0, (char *) ARG1, ARG2)); break;
+        case SYS_TUNE: RET(sys_tune((char *) ARG0)); break;
+        case SYS_GETTIME: RET(sys_gettime()); break;
+        case SYS_GETRUSAGE: RET(sys_getrusage((struct rusage *) ARG0)); break;
         default: process_terminate(); // Invalid syscall
     }
 
@@ -528,5 +825,16 @@ static void syscall_handler(intr_frame_t *f) {
     #undef ARG1
     #undef ARG2
 
+    uint32_t bytes = 0;
+    if ((num == SYS_READ || num == SYS_WRITE) && f->eax != SC_ERR) {
+        bytes = f->eax;
+        if (num == SYS_READ)
+            thread_current()->usage.bytes_read += bytes;
+        else
+            thread_current()->usage.bytes_written += bytes;
+    }
+    count_return(num, rdtsc() - start, bytes);
+    TRACE(TRACE_SYSCALL_EXIT, syscall_names[num], f->eax, 0);
+
     thread_current()->stack_pointer = NULL;
 }
\ No newline at end of file
@@ -1,7 +1,22 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/interrupt.h"
+
+/*! Whether to print each process's system call statistics when it exits,
+    and the totals at shutdown. Set by the -scstats command-line option. */
+extern bool syscall_stats_enabled;
+
+/*! Most bytes written to the console at once by the write system call. A
+    tunable. */
+extern size_t syscall_max_print;
+
 void syscall_init(void);
+void syscall_fast_handler(intr_frame_t *);
+void syscall_exit(void);
+size_t syscall_stats_format(char *buf, size_t size);
+void syscall_print_stats(void);
 
 #endif /* userprog/syscall.h */
-
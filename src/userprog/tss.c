@@ -1,5 +1,6 @@
 #include "userprog/tss.h"
 #include <debug.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
 #include "threads/thread.h"
@@ -68,6 +69,27 @@ struct tss {
 /*! Kernel TSS. */
 static struct tss *tss;
 
+/*! Model-specific registers used by SYSENTER. @{ */
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+/*! @} */
+
+/*! Entry point for SYSENTER, in sysenter.S. */
+void sysenter_entry(void);
+
+/*! Returns true if the processor supports SYSENTER and SYSEXIT. */
+static bool cpu_has_sysenter(void) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+    return (edx & (1 << 11)) != 0;
+}
+
+/*! Writes VALUE to model-specific register MSR. */
+static void wrmsr(uint32_t msr, uint32_t value) {
+    asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
 /*! Initializes the kernel TSS. */
 void tss_init(void) {
     /* Our TSS is never used in a call gate or task gate, so only a few fields
@@ -76,6 +98,16 @@ void tss_init(void) {
     tss->ss0 = SEL_KDSEG;
     tss->bitmap = 0xdfff;
     tss_update();
+
+    /* SYSENTER loads the stack pointer from an MSR, which we point at esp0
+       rather than rewriting it on every thread switch; sysenter_entry()
+       loads the kernel stack from there. SYSEXIT's user selectors are
+       derived from SEL_KCSEG, which gdt_init() lays out to match. */
+    if (cpu_has_sysenter()) {
+        wrmsr(MSR_SYSENTER_CS, SEL_KCSEG);
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t) &tss->esp0);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    }
 }
 
 /*! Returns the kernel TSS. */
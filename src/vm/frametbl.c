@@ -3,10 +3,34 @@
 #include "userprog/pagedir.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include <round.h>
 #include <stdio.h>
 
 #define UNPINNED 1 // Frames started with semaphores unpinned
 
+/*! Number of frames evicted at once when there are no unused frames, so that
+    their pages can be swapped out together. At most VM_EVICT_MAX. */
+#define EVICT_BATCH 4
+
+/*! Number of blocks the frame table is split into for aging. Each aging pass
+    ages one block's worth of frames. Set by the -age-blocks option. */
+size_t frametbl_age_blocks = 2;
+
+/*! Number of user ticks between aging passes. Set by the -age-freq option. */
+size_t frametbl_age_freq = 2;
+
+/*! Maximum number of frames aged by a single pass, regardless of how large
+    a block is. Set by the -age-budget option. */
+size_t frametbl_age_budget = 512;
+
+static semaphore_t age_request;     /*!< Upped to wake the aging thread. */
+static bool age_pending;            /*!< A pass was requested but not begun. */
+static size_t age_hand;             /*!< Next frame to be aged. */
+static size_t evict_hand;           /*!< Where to start looking for victims. */
+static long long age_ticks;         /*!< User ticks seen by frametbl_tick(). */
+
 static bool try_pin_fte(fte_t *fte);
 static void unpin_fte(fte_t *fte);
 
@@ -49,6 +73,8 @@ static void init_frametbl(size_t num_frames) {
     frame_tbl->num_frames = num_frames;
     list_init(&frame_tbl->unused);
     lock_init(&frame_tbl->lock);
+    lock_set_name(&frame_tbl->lock, "frame table");
+    sema_init(&age_request, 0);
 
     fte_t *tbl = frame_tbl->tbl;
     for (size_t i = 0; i < num_frames; i++) {
@@ -91,57 +117,120 @@ static bool valid_frame(void *frame) {
             && get_fte_inx(get_fte(frame)) < frame_tbl->num_frames;
 }
 
-/*! Performs the aging required on a tick. Invoked by thread_tick(). */
-void frametbl_tick(size_t block, size_t block_cnt) {
-    size_t start = frame_tbl->num_frames * block / block_cnt;
-    size_t end = frame_tbl->num_frames * (block + 1) / block_cnt;
-    for (size_t i = start; i < end; i++) {
-        fte_t *fte = &frame_tbl->tbl[i];
-        int a = vm_try_reset_accessed(fte->mapping);
-        if (a != -1 && try_pin_fte(fte)) {
-            fte->age >>= 1;
-            fte->age |= a << 7;
+/*! Ages a single frame. Interrupts are disabled only for the duration of
+    this frame, so that the frame cannot be pinned or evicted halfway through
+    while still keeping interrupt latency independent of the frame count.
+    Returns true if the frame's accessed bit was cleared. */
+static bool age_frame(fte_t *fte) {
+    enum intr_level old_level = intr_disable();
+    int a = vm_try_reset_accessed(fte->mapping);
+    if (a != -1 && try_pin_fte(fte)) {
+        fte->age >>= 1;
+        fte->age |= a << 7;
+        unpin_fte(fte);
+    }
+    intr_set_level(old_level);
+    return a == 1;
+}
+
+/*! Ages the next block of the frame table, up to frametbl_age_budget
+    frames. Successive passes continue where the previous one stopped. */
+static void age_pass(void) {
+    size_t n = DIV_ROUND_UP(frame_tbl->num_frames, frametbl_age_blocks);
+    if (n > frametbl_age_budget) n = frametbl_age_budget;
+    bool cleared = false;
+    for (size_t i = 0; i < n; i++) {
+        cleared |= age_frame(&frame_tbl->tbl[age_hand]);
+        age_hand = (age_hand + 1) % frame_tbl->num_frames;
+    }
+    // one flush for the whole pass rather than one per accessed bit
+    if (cleared) pagedir_flush_tlb();
+}
+
+/*! Body of the aging thread. Performs one pass per request. */
+static void ager(void *aux UNUSED) {
+    while (true) {
+        sema_down(&age_request);
+        age_pending = false;
+        age_pass();
+    }
+}
+
+/*! Starts the thread which performs frame aging. Must be called after the
+    scheduler has started. */
+void frametbl_start_aging(void) {
+    if (frametbl_age_blocks == 0) frametbl_age_blocks = 1;
+    if (frametbl_age_freq == 0) frametbl_age_freq = 1;
+    if (frametbl_age_budget == 0) frametbl_age_budget = 1;
+    thread_create("frame ager", PRI_MAX, ager, NULL);
+}
+
+/*! Invoked by thread_tick() on every tick spent in a user process. Requests
+    an aging pass every frametbl_age_freq such ticks; the aging itself is
+    deferred to the aging thread. Requests made while a pass is still pending
+    are merged into it. */
+void frametbl_tick(void) {
+    ASSERT(intr_context());
+    if (++age_ticks % frametbl_age_freq == 0 && !age_pending) {
+        age_pending = true;
+        sema_up(&age_request);
+    }
+}
+
+/*! Scans the frame table once, starting at HAND, for the oldest frame which
+    holds a page and can be pinned. Returns it pinned, or NULL if there is no
+    such frame. */
+static fte_t *scan_for_victim(size_t hand) {
+    fte_t *best = NULL;
+    age_t best_age = AGE_MAX;
+    for (size_t i = 0; i < frame_tbl->num_frames; i++) {
+        fte_t *fte = &frame_tbl->tbl[(i + hand) % frame_tbl->num_frames];
+        if (!try_pin_fte(fte)) continue;
+
+        if (fte->mapping != NULL && best_age >= fte->age) {
+            if (best != NULL) unpin_fte(best);
+            best_age = fte->age;
+            best = fte;
+        } else {
             unpin_fte(fte);
         }
+
+        if (best_age == 0) return best;
     }
+    return best;
 }
 
 /*! Chooses a frame to evict. */
 static fte_t *frame_to_evict(void) {
-    static size_t hand_shared = 0;
     while (true) {
-        size_t hand = hand_shared++;
-        fte_t *best = NULL;
-        age_t best_age = AGE_MAX;
-        for (size_t i = 0; i < frame_tbl->num_frames; i++) {
-            fte_t *fte = &frame_tbl->tbl[(i + hand) % frame_tbl->num_frames];
-            if (!try_pin_fte(fte)) continue;
-
-            if (best_age >= fte->age) {
-                if (best != NULL) unpin_fte(best);
-                best_age = fte->age;
-                best = fte;
-            } else {
-                unpin_fte(fte);
-            }
-            
-            if (best_age == 0) return best;
-        }
+        fte_t *best = scan_for_victim(evict_hand++);
         if (best != NULL) return best;
     }
 }
 
+/*! Evicts a batch of up to EVICT_BATCH of the oldest frames, so that pages
+    going to swap are written out together. */
+static void evict_frames(void) {
+    vm_mapping_t *victims[EVICT_BATCH];
+    size_t cnt = 0;
+    victims[cnt++] = frame_to_evict()->mapping;
+    while (cnt < EVICT_BATCH) {
+        fte_t *fte = scan_for_victim(evict_hand++);
+        if (fte == NULL) break;
+        victims[cnt++] = fte->mapping;
+    }
+    vm_evict_pages(victims, cnt);
+}
+
 /*! Gets a frame (kernel virtual address) from the frame table for
     immediate use. The returned frame is pinned and should be unpinned by the
     user if necessary. */
 frame_t *frametbl_get_frame(void) {
-    fte_t *fte;
     lock_acquire(&frame_tbl->lock);
 
     while (list_empty(&frame_tbl->unused)) {
         lock_release(&frame_tbl->lock);
-        fte = frame_to_evict();
-        vm_evict_page(fte->mapping);
+        evict_frames();
         lock_acquire(&frame_tbl->lock);
     }
 
@@ -151,6 +240,19 @@ frame_t *frametbl_get_frame(void) {
     return frame;
 }
 
+/*! Like frametbl_get_frame, but returns NULL instead of evicting a page if
+    there are no unused frames. */
+frame_t *frametbl_try_get_frame(void) {
+    void *frame = NULL;
+    lock_acquire(&frame_tbl->lock);
+    if (!list_empty(&frame_tbl->unused)) {
+        frame = list_entry_frame(list_pop_front(&frame_tbl->unused));
+        ASSERT(frametbl_try_pin_frame(frame));
+    }
+    lock_release(&frame_tbl->lock);
+    return frame;
+}
+
 /*! Installs PAGE (user virtual address) into FRAME (kernel virtual address,
     presumably from palloc_get_page) in the frame table. */
 bool frametbl_install_page(vm_mapping_t *mapping, frame_t *frame) {
@@ -43,12 +43,18 @@ frametbl_t *frametbl_create_in_buf(size_t num_frames, void *block,
     size_t block_size);
 
 frame_t *frametbl_get_frame(void);
+frame_t *frametbl_try_get_frame(void);
 bool frametbl_install_page(vm_mapping_t *mapping, frame_t *frame);
 void frametbl_empty_frame(frame_t *frame);
 
 bool frametbl_try_pin_frame(frame_t *frame);
 void frametbl_unpin_frame(frame_t *frame);
 
-void frametbl_tick(size_t block, size_t block_cnt);
+extern size_t frametbl_age_blocks;
+extern size_t frametbl_age_freq;
+extern size_t frametbl_age_budget;
+
+void frametbl_start_aging(void);
+void frametbl_tick(void);
 
 #endif /* VM_FRAME_H */
\ No newline at end of file
@@ -8,10 +8,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
-#include "threads/malloc.h"
+#include <kdata.h>
+#include <list.h>
 #include "threads/init.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
 #include "userprog/pagedir.h"
 #include "vm/frametbl.h"
 #include "vm/swaptbl.h"
@@ -19,44 +23,92 @@
 
 #include <stdio.h>
 
+/*! A range of pages which the user may access, all of which get their
+    contents the same way. Regions are what exec and mmap create, so their
+    cost does not depend on the number of pages; the state of an individual
+    page is only allocated, as a vm_mapping, when the page is first touched. */
+typedef struct vm_region {
+    avl_elem_t elem;    /*!< Element in the page table's region tree. */
+    void *start;        /*!< First page of the region. */
+    size_t page_cnt;    /*!< Number of pages in the region. */
+    file_t *file;       /*!< File backing the region, or NULL if anonymous.
+                             Owned by the region if fwrite is true. */
+    off_t offset;       /*!< Offset in the file of the first page. */
+    size_t file_bytes;  /*!< Bytes of the region which come from the file. The
+                             pages after them are anonymous. */
+    bool writable;      /*!< The region is writable. */
+    bool fwrite;        /*!< Changes are written back to the file. */
+    bool map_start;     /*!< The region is a file mapping made by mmap. */
+    bool isstack;       /*!< The region is the stack. */
+    list_t pages;       /*!< Mappings of the pages which have been touched. */
+} vm_region_t;
+
 /*! Represents what a virtual page should contain. */
 struct vm_mapping {
-    hash_elem_t elem;   /*!< Element to insert in hash. */
+    ihash_elem_t elem;  /*!< Element to insert in hash. */
+    list_elem_t region_elem;    /*!< Element in the region's page list. */
     void *page;         /*!< Address being mapped from. */
     bin_sema_t lock;    /*!< Page lock. */
     int present : 1;    /*!< this address is currently mapped. */
-    int writable : 1;   /*!< this mapping is writable. */
-    int hasfile : 1;    /*!< this is a file-backed mapping. */
+    int hasfile : 1;    /*!< this page is read from the region's file. */
     int fwrite : 1;     /*!< the backing file can be written to. */
-    int map_start : 1;  /*!< this is the start of a file mapping. */
     int orphaned : 1;   /*!< this mapping is unmapped and should be freed when
                              it is next evicted. */
     int swapped : 1;    /*!< Whether the page has been swapped. If it is not
-                             present, data.swap_slot indicates the slot. */
-    int isstack : 1;    /*!< Whether the page is a stack page. */
+                             present, swap_slot indicates the slot. */
+    int zero : 1;       /*!< The page is untouched and anonymous, and mapped
+                             read-only to the shared zero frame. It is not
+                             present: it has no frame of its own. */
     sup_pagetable_t *pt;/*!< The page table this mapping belongs to, if orphaned
                              is false. Undefined if orphaned is true. */
+    vm_region_t *region;/*!< The region containing the page, if orphaned is
+                             false. Undefined if orphaned is true. */
     frame_t *frame;     /*!< The frame currently mapped to. 
                              Undefined if present and orphaned are false. */
-    union {
-        struct {
-            file_t *file;           /*!< File to read/write from. */
-            unsigned offset : 20;   /*!< Location in the file in pages. */
-            unsigned size : 12;     /*!< Max bytes to read from the file - 1. */
-        } file_info;                /*!< Valid if hasfile is true. */
-        uintptr_t swap_slot;        /*!< Valid if hasfile and present are false. */
-    } data;
+    uintptr_t swap_slot;/*!< Valid if swapped is true and present is false. */
 };
 
+/*! Frame of zeros which is mapped read-only into every anonymous page which
+    has only been read, so that such pages need not be allocated. */
+static frame_t *zero_frame;
+
+/*! Caches from which regions and mappings are allocated. @{ */
+static kmem_cache_t *region_cache;
+static kmem_cache_t *mapping_cache;
+/*! @} */
+
+static vm_region_t *region_entry(const avl_elem_t *a);
+static vm_region_t *region_lookup(sup_pagetable_t *pt, const void *addr);
+static bool region_less(const avl_elem_t *a, const avl_elem_t *b,
+                        void *aux UNUSED);
+static void region_destroy(avl_elem_t *a, void *aux UNUSED);
 static vm_mapping_t *mapping_lookup(sup_pagetable_t *pt, const void *addr);
+static vm_mapping_t *mapping_get(sup_pagetable_t *pt, const void *addr);
 
-static vm_mapping_t *map_entry(const hash_elem_t *a);
-static unsigned mapping_hash(const hash_elem_t *a, void *aux UNUSED);
-static bool mapping_less(const hash_elem_t *a, const hash_elem_t *b,
+static vm_mapping_t *map_entry(const ihash_elem_t *a);
+static unsigned mapping_hash(const ihash_elem_t *a, void *aux UNUSED);
+static bool mapping_less(const ihash_elem_t *a, const ihash_elem_t *b,
                          void *aux UNUSED); 
-static void mapping_destroy(hash_elem_t *a, void *aux UNUSED);
+static void mapping_destroy(ihash_elem_t *a, void *aux UNUSED);
 static void mapping_free(vm_mapping_t *mapping);
-static void mapping_delete(sup_pagetable_t *pt, const void *addr);
+
+/*! Constructs a mapping: its lock is up whenever it is freed. */
+static void mapping_ctor(void *mapping) {
+    bin_sema_init(&((vm_mapping_t *) mapping)->lock, 1);
+}
+
+/*! Initializes the virtual memory system. */
+void vm_init(void) {
+    zero_frame = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+    region_cache = kmem_cache_create("vm region", sizeof(vm_region_t), NULL);
+    mapping_cache = kmem_cache_create("vm mapping", sizeof(vm_mapping_t),
+                                      mapping_ctor);
+}
+
+/*! Returns the shared zero frame. It is never pinned. */
+frame_t *vm_zero_frame(void) {
+    return zero_frame;
+}
 
 /*! Creates a supplemental page table at the given buffer. Returns false if
     memory allocation fails and true on success. */
@@ -66,7 +118,8 @@ bool sup_pt_create(sup_pagetable_t *pt) {
     if (pt->pd == NULL) {
         return false;
     }
-    if (!hash_init(&pt->mappings, mapping_hash, mapping_less, NULL)) {
+    avl_init(&pt->regions, region_less, NULL);
+    if (!ihash_init(&pt->mappings, mapping_hash, mapping_less, NULL)) {
         pagedir_destroy(pt->pd);
         return false;
     }
@@ -86,7 +139,9 @@ void sup_pt_destroy(sup_pagetable_t *pt) {
     uint32_t *pd = pt->pd;
     pt->user = false;
     pagedir_activate(NULL);
-    hash_destroy(&pt->mappings, mapping_destroy);
+    // pages are flushed to their region's file, so regions go last
+    ihash_destroy(&pt->mappings, mapping_destroy);
+    avl_destroy(&pt->regions, region_destroy);
     pagedir_destroy(pd);
 }
 
@@ -104,113 +159,169 @@ bool sup_pt_is_kernel(sup_pagetable_t *pt) {
     return !pt->user;
 }
 
-/*! Marks where a user page expects its memory to come from, without actually
-    necessarily loading that memory into a frame. This does not affect 
-    actual mappings.
+/*! Returns whether the user pages from START up to END include the kernel
+    data page, which every process has mapped outside of its regions. */
+static bool is_kdata(const void *start, const void *end) {
+    return start <= (void *) KDATA_ADDR && end > (void *) KDATA_ADDR;
+}
 
-    Does not lock the page because an eviction can't occur until load occurs,
-    and load cannot occur until this returns.
+/*! Marks where the PAGE_CNT user pages starting at UPAGE expect their memory
+    to come from, without actually necessarily loading that memory into a
+    frame. This does not affect actual mappings. Returns false if memory
+    allocation fails or if any of the pages are already mapped or outside of
+    user space.
 
-    If backing file is not NULL, offset specifies where in the file it is and
-    file_writable specifies whether you're allowed to write changes back to the
-    file when evicting the page. */
-bool vm_set_page(sup_pagetable_t *pt, void *upage, uint32_t flags,
-                     file_t *backing, off_t ofs, size_t size) {
+    If backing file is not NULL, the first FILE_BYTES bytes of the pages are
+    read from it starting at offset OFS, and the rest are zeroed. With
+    MAP_FWRITE, changes are written back to the file when pages are evicted,
+    through a file of the region's own; otherwise FILE must stay open for as
+    long as the region exists. */
+bool vm_map_region(sup_pagetable_t *pt, void *upage, size_t page_cnt,
+                   uint32_t flags, file_t *backing, off_t ofs,
+                   size_t file_bytes) {
     ASSERT(pg_ofs(upage) == 0);
-    ASSERT(is_user_vaddr(upage));
     ASSERT(pt->pd != init_page_dir);
 
-    vm_mapping_t *mapping = calloc(1, sizeof(vm_mapping_t));
-    if (mapping == NULL) return false;
-    bin_sema_init(&mapping->lock, 1);
-    mapping->page = upage;
-    mapping->writable = (flags & MAP_WRITE) != 0;
-    mapping->map_start = (flags & MAP_START) != 0;
-    mapping->isstack = (flags & MAP_STACK) != 0;
-    mapping->pt = pt;
+    void *end = upage + page_cnt * PGSIZE;
+    if (page_cnt == 0 || !is_user_vaddr(upage) || end <= upage
+        || end > PHYS_BASE || is_kdata(upage, end)) {
+        return false;
+    }
+    // regions don't overlap, so only the last one starting before the end
+    // of the new region can overlap it
+    vm_region_t lookup = {.start = end - PGSIZE};
+    avl_elem_t *elem = avl_floor(&pt->regions, &lookup.elem);
+    if (elem != NULL) {
+        vm_region_t *prev = avl_entry(elem, vm_region_t, elem);
+        if (prev->start + prev->page_cnt * PGSIZE > upage) return false;
+    }
 
-    if (backing != NULL && size > 0) {
+    vm_region_t *region = kmem_cache_alloc(region_cache);
+    if (region == NULL) return false;
+    memset(region, 0, sizeof *region);
+    region->start = upage;
+    region->page_cnt = page_cnt;
+    region->writable = (flags & MAP_WRITE) != 0;
+    region->map_start = (flags & MAP_START) != 0;
+    region->isstack = (flags & MAP_STACK) != 0;
+    list_init(&region->pages);
+
+    if (backing != NULL && file_bytes > 0) {
         ASSERT(ofs % PGSIZE == 0);
-        ASSERT(size <= PGSIZE);
-        mapping->hasfile = 1;
-        mapping->fwrite = (flags & MAP_FWRITE) != 0;
-        if (mapping->fwrite) {
+        ASSERT(file_bytes <= page_cnt * PGSIZE);
+        region->fwrite = (flags & MAP_FWRITE) != 0;
+        if (region->fwrite) {
             if ((backing = file_reopen(backing)) == NULL) {
-                free(mapping);
+                kmem_cache_free(region_cache, region);
                 return false;
             }
         }
-        mapping->data.file_info.file = backing;
-        mapping->data.file_info.offset = ofs / PGSIZE;
-        mapping->data.file_info.size = size - 1;
+        region->file = backing;
+        region->offset = ofs;
+        region->file_bytes = file_bytes;
     }
 
-    ASSERT(hash_insert(&pt->mappings, &mapping->elem) == NULL);
-
+    ASSERT(avl_insert(&pt->regions, &region->elem) == NULL);
     return true;
 }
 
-/*! Sets a given page with the flags for a stack page. */
-bool vm_set_stack_page(sup_pagetable_t *pt, void *upage) {
-    return vm_set_page(pt, upage, MAP_WRITE | MAP_STACK, NULL, 0, 0);
+/*! Removes the file mapping starting at UPAGE, making its pages no longer
+    accessible and flushing them to disk. Returns false if UPAGE is not the
+    start of a file mapping. */
+bool vm_unmap_region(sup_pagetable_t *pt, void *upage) {
+    vm_region_t *region = region_lookup(pt, upage);
+    if (region == NULL || !region->map_start || region->start != upage) {
+        return false;
+    }
+
+    // only the pages which were touched have anything to release
+    while (!list_empty(&region->pages)) {
+        vm_mapping_t *mapping = list_entry(list_pop_front(&region->pages),
+                                           vm_mapping_t, region_elem);
+        ihash_delete(&pt->mappings, &mapping->elem);
+        pagedir_clear_page(pt->pd, mapping->page);
+        mapping_destroy(&mapping->elem, NULL);
+    }
+    avl_delete(&pt->regions, &region->elem);
+    region_destroy(&region->elem, NULL);
+    return true;
 }
 
 /*! Installs a stack page (anonymous, writable) at the given virtual address and
     then returns the frame. Returns NULL on failure, including if there is 
     already a page at this address. The returned frame is pinned. */
 frame_t *vm_set_load_stack_page(sup_pagetable_t *pt, void *upage) {
-    if (!vm_page_is_mappable(pt, upage) || !vm_set_stack_page(pt, upage)) {
+    if (!vm_map_region(pt, upage, 1, MAP_WRITE | MAP_STACK, NULL, 0, 0)) {
+        return NULL;
+    }
+    return vm_load_page(pt, upage, true);
+}
+
+/*! Grows the stack down to UPAGE, which must be below it, and loads UPAGE.
+    Returns the frame, pinned, or NULL on failure, including if any other
+    page lies between UPAGE and the stack. */
+frame_t *vm_grow_stack(sup_pagetable_t *pt, void *upage) {
+    ASSERT(pg_ofs(upage) == 0);
+
+    if (!is_user_vaddr(upage) || region_lookup(pt, upage) != NULL) {
         return NULL;
     }
-    return vm_load_page(pt, upage);
+    vm_region_t lookup = {.start = upage};
+    avl_elem_t *elem = avl_ceil(&pt->regions, &lookup.elem);
+    if (elem == NULL) return NULL;
+    vm_region_t *stack = avl_entry(elem, vm_region_t, elem);
+    if (!stack->isstack) return NULL;
+
+    // nothing lies between UPAGE and the stack, so moving the start of the
+    // stack down to UPAGE keeps the tree ordered
+    stack->page_cnt += (stack->start - upage) / PGSIZE;
+    stack->start = upage;
+    return vm_load_page(pt, upage, true);
 }
 
 /*! Checks whether the given page is mapped for the user. */
 bool vm_page_is_mapped(sup_pagetable_t *pt, const void *upage) {
     ASSERT(pg_ofs(upage) == 0);
 
-    return mapping_lookup(pt, upage) != NULL;
+    return region_lookup(pt, upage) != NULL;
 }
 
 /*! Returns true if the given page exists and can be written by the user. */
 bool vm_page_is_writeable(sup_pagetable_t *pt, const void *upage) {
     ASSERT(pg_ofs(upage) == 0);
 
-    vm_mapping_t *mapping = mapping_lookup(pt, upage);
-    return mapping != NULL && mapping->writable;
+    vm_region_t *region = region_lookup(pt, upage);
+    return region != NULL && region->writable;
 }
 
 /*! Returns true if the given page could be mapped by the user. If this returns
-    true, a call to vm_set_page should be valid, barring race conditions. */
+    true, a call to vm_map_region for just this page should be valid, barring
+    race conditions. */
 bool vm_page_is_mappable(sup_pagetable_t *pt, const void *upage) {
     ASSERT(pg_ofs(upage) == 0);
 
-    return is_user_vaddr(upage) && mapping_lookup(pt, upage) == NULL;
+    return is_user_vaddr(upage) && !is_kdata(upage, upage + PGSIZE)
+           && region_lookup(pt, upage) == NULL;
 }
 
 /*! Checks whether a page is a stack page. */
 bool vm_page_is_stack(sup_pagetable_t *pt, const void *upage) {
     ASSERT(pg_ofs(upage) == 0);
 
-    vm_mapping_t *mapping = mapping_lookup(pt, upage);
-    return mapping != NULL && mapping->isstack;
+    vm_region_t *region = region_lookup(pt, upage);
+    return region != NULL && region->isstack;
 }
 
-/*! Returns true if the given page is the start of a file mapping. */
-bool vm_page_is_mapping_start(sup_pagetable_t *pt, const void *upage) {
-    ASSERT(pg_ofs(upage) == 0);
+/*! Returns the number of bytes of MAPPING's page which are read from its
+    region's file, and stores their offset in the file in *OFS. */
+static size_t file_range(vm_mapping_t *mapping, off_t *ofs) {
+    vm_region_t *region = mapping->region;
+    size_t start = mapping->page - region->start;
+    size_t size = region->file_bytes - start;
 
-    vm_mapping_t *mapping = mapping_lookup(pt, upage);
-    return mapping != NULL && mapping->map_start;
-}
-
-/*! Returns the last page in a file mapping. Input page must be the start of
-    a file mapping. */
-void *vm_page_get_mapping_end(sup_pagetable_t *pt, const void *upage) {
-    vm_mapping_t *mapping = mapping_lookup(pt, upage);
-    ASSERT(mapping != NULL && mapping->map_start);
-    size_t len = file_length(mapping->data.file_info.file);
-    return pg_round_down(upage + len - 1);
+    ASSERT(start < region->file_bytes);
+    *ofs = region->offset + start;
+    return size < PGSIZE ? size : PGSIZE;
 }
 
 /*! Loads and populates a frame for an anonymous page. Return NULL on failure,
@@ -230,9 +341,9 @@ static void *load_file_page(vm_mapping_t *mapping) {
         return NULL;
     }
 
-    file_t *file = mapping->data.file_info.file;
-    off_t offset = mapping->data.file_info.offset * PGSIZE;
-    size_t size = mapping->data.file_info.size + 1;
+    off_t offset;
+    size_t size = file_range(mapping, &offset);
+    file_t *file = mapping->region->file;
     file_seek(file, offset);
     off_t eof = file_read(file, kpage, size);
 
@@ -240,37 +351,100 @@ static void *load_file_page(vm_mapping_t *mapping) {
     return kpage;
 }
 
-/*! Loads and populates a frame from swap. Return NULL on failure, otherwise
-    the frame. */
-static void *load_swap_page(vm_mapping_t *mapping) {
+/*! Number of swap slots following a faulting page's slot which are read
+    ahead, if they hold pages of the same process. */
+#define SWAP_READ_AHEAD 3
+
+/*! Loads and populates a frame from swap for MAPPING, which belongs to PT.
+    Also loads the pages of PT which were swapped into the slots following
+    MAPPING's, as long as they can be loaded without evicting anything. Pages
+    evicted together are likely to be needed together, and adjacent slots are
+    read with a single transfer. Returns NULL on failure, otherwise the
+    frame. */
+static void *load_swap_page(sup_pagetable_t *pt, vm_mapping_t *mapping) {
     ASSERT(mapping != NULL);
     ASSERT(mapping->swapped);
 
-    void *kpage = palloc_get_page(PAL_USER);
-    if (kpage == NULL) {
+    void *kpages[SWAP_READ_AHEAD + 1];
+    uintptr_t slots[SWAP_READ_AHEAD + 1];
+    vm_mapping_t *ahead[SWAP_READ_AHEAD];
+    size_t cnt = 0;
+
+    kpages[0] = palloc_get_page(PAL_USER);
+    if (kpages[0] == NULL) {
         return NULL;
     }
-    swaptbl_load(kpage, mapping->data.swap_slot);
-    return kpage;
+    slots[0] = mapping->swap_slot;
+    for (uintptr_t next = slots[0] + 1; cnt < SWAP_READ_AHEAD; next++) {
+        vm_mapping_t *m = swaptbl_owner(next, pt);
+        if (m == NULL || !bin_sema_try_down(&m->lock)) break;
+        void *kpage = NULL;
+        if (!m->present && m->swapped && m->swap_slot == next) {
+            kpage = palloc_get_page(PAL_USER | PAL_NOEVICT);
+        }
+        if (kpage != NULL && !pagedir_set_page(pt->pd, m->page, kpage,
+                                               m->region->writable)) {
+            palloc_free_page(kpage);
+            kpage = NULL;
+        }
+        if (kpage == NULL) {
+            bin_sema_up(&m->lock);
+            break;
+        }
+        ahead[cnt++] = m;
+        kpages[cnt] = kpage;
+        slots[cnt] = next;
+    }
+
+    swaptbl_load_batch(kpages, slots, cnt + 1);
+    for (size_t i = 0; i < cnt; i++) {
+        vm_mapping_t *m = ahead[i];
+        m->present = true;
+        m->frame = kpages[i + 1];
+        frametbl_install_page(m, kpages[i + 1]);
+        frametbl_unpin_frame(kpages[i + 1]);
+        bin_sema_up(&m->lock);
+    }
+    return kpages[0];
 }
 
 /*! Helper for vm_load_page which optionally allows not acquiring the page lock.
     If called with should_lock false, the page lock should already be held by
     the caller. */
-static frame_t *_load_page(sup_pagetable_t *pt, void *upage, bool should_lock) {
+static frame_t *_load_page(sup_pagetable_t *pt, void *upage, bool write,
+                           bool should_lock) {
     ASSERT(!pg_ofs(upage));
     ASSERT(is_user_vaddr(upage));
 
-    vm_mapping_t *mapping = mapping_lookup(pt, upage);
-    ASSERT(mapping != NULL);
+    vm_mapping_t *mapping = mapping_get(pt, upage);
+    if (mapping == NULL) return NULL;
 
     if (should_lock) bin_sema_down(&mapping->lock);
+    if (mapping->zero) {
+        if (!write) goto zero;
+        // first write, so the page needs a frame of its own
+        pagedir_clear_page(pt->pd, upage);
+        mapping->zero = false;
+    } else if (!write && !mapping->hasfile && !mapping->swapped) {
+        if (!pagedir_set_page(pt->pd, upage, zero_frame, false)) {
+            if (should_lock) bin_sema_up(&mapping->lock);
+            return NULL;
+        }
+        mapping->zero = true;
+        TRACE(TRACE_PAGE_FAULT, upage, "zero frame", write);
+        goto zero;
+    }
+
     void *kpage;
     if (mapping->hasfile) {
+        TRACE(TRACE_PAGE_FAULT, upage, "file", write);
         kpage = load_file_page(mapping);
     } else if (mapping->swapped) {
-        kpage = load_swap_page(mapping);
+        TRACE(TRACE_PAGE_FAULT, upage, "swap", write);
+        thread_current()->usage.swap_ins++;
+        kpage = load_swap_page(pt, mapping);
     } else { // no file and not in swap, so get a zero page
+        TRACE(TRACE_PAGE_FAULT, upage, "zero", write);
         kpage = load_anonymous_page();
     }
 
@@ -278,7 +452,7 @@ static frame_t *_load_page(sup_pagetable_t *pt, void *upage, bool should_lock) {
         return NULL;
     }
 
-    if (!pagedir_set_page(pt->pd, upage, kpage, mapping->writable)) {
+    if (!pagedir_set_page(pt->pd, upage, kpage, mapping->region->writable)) {
         palloc_free_page(kpage);
         return NULL;
     }
@@ -287,76 +461,103 @@ static frame_t *_load_page(sup_pagetable_t *pt, void *upage, bool should_lock) {
     frametbl_install_page(mapping, kpage);
     if (should_lock) bin_sema_up(&mapping->lock);
     return kpage;
+
+    zero:
+    if (should_lock) bin_sema_up(&mapping->lock);
+    return zero_frame;
 }
 
 /*! Loads a frame for UPAGE with the correct information in it, using the
     information in PT. Requires that UPAGE does not already have a frame.
     Returns the frame, pinned (which the user must unpin), or NULL on
-    failure. 
-    */
-frame_t *vm_load_page(sup_pagetable_t *pt, void *upage) {
-    return _load_page(pt, upage, true);
+    failure.
+
+    If WRITE is false and UPAGE is an anonymous page which has never been
+    written, the shared zero frame is mapped read-only instead and returned.
+    It is not pinned, and a later write fault on UPAGE gives the page its own
+    frame. */
+frame_t *vm_load_page(sup_pagetable_t *pt, void *upage, bool write) {
+    return _load_page(pt, upage, write, true);
 }
 
 /*! Writes a mapping to a file. */
 static void evict_to_file(vm_mapping_t *mapping) {
     ASSERT(mapping != NULL);
 
-    file_t *file = mapping->data.file_info.file;
-    off_t offset = mapping->data.file_info.offset * PGSIZE;
-    size_t size = mapping->data.file_info.size + 1;
+    off_t offset;
+    size_t size = file_range(mapping, &offset);
+    file_t *file = mapping->region->file;
     frame_t *frame = mapping->frame;
     file_seek(file, offset);
     file_write(file, frame->bytes, size);
 }
 
-/*! Instructs the supplemental PT to evict a user-space page UPAGE from its
-    frame. Requires that the page is pinned and frees it. */
-void vm_evict_page(vm_mapping_t *mapping) {
-    if (mapping == NULL) return;
-    ASSERT(mapping->present);
-    
-    frame_t *frame = mapping->frame;
-    bin_sema_down(&mapping->lock);
-    if (mapping->orphaned) {
-        mapping_free(mapping);
-        return;
-    }
+/*! Instructs the supplemental PT to evict the CNT user-space pages in
+    MAPPINGS from their frames. Requires that the pages are pinned and frees
+    them. Pages which must go to swap are written as one batch, so that they
+    land in adjacent swap slots. Null entries are skipped. */
+void vm_evict_pages(vm_mapping_t **mappings, size_t cnt) {
+    vm_mapping_t *swapped[VM_EVICT_MAX];
+    void *frames[VM_EVICT_MAX];
+    sup_pagetable_t *pts[VM_EVICT_MAX];
+    uintptr_t slots[VM_EVICT_MAX];
+    size_t swap_cnt = 0;
 
-    mapping->present = false;
-    bool is_dirty = pagedir_is_dirty(mapping->pt->pd, mapping->page);
-    pagedir_clear_page(mapping->pt->pd, mapping->page);
+    ASSERT(cnt <= VM_EVICT_MAX);
 
-    if (!is_dirty && !mapping->swapped) goto exit; // clean page, no need to be saved
+    for (size_t i = 0; i < cnt; i++) {
+        vm_mapping_t *mapping = mappings[i];
+        if (mapping == NULL) continue;
+        ASSERT(mapping->present);
 
-    // the page is dirty, we need to save it
-    if (mapping->hasfile) {
-        if (!mapping->fwrite) { // can't write to file, swap
-            mapping->fwrite = mapping->hasfile = false;
-            goto swap;
+        frame_t *frame = mapping->frame;
+        bin_sema_down(&mapping->lock);
+        if (mapping->orphaned) {
+            mapping_free(mapping);
+            continue;
         }
-        // write back to file
-        evict_to_file(mapping);
-    } else {
-        swap:
-        mapping->swapped = true;
-        mapping->data.swap_slot = swaptbl_store(frame);
+
+        mapping->present = false;
+        bool is_dirty = pagedir_is_dirty(mapping->pt->pd, mapping->page);
+        pagedir_clear_page(mapping->pt->pd, mapping->page);
+
+        // clean pages need not be saved
+        if (is_dirty || mapping->swapped) {
+            if (mapping->hasfile && mapping->fwrite) {
+                // write back to file
+                TRACE(TRACE_EVICT, mapping->page, "file", 0);
+                evict_to_file(mapping);
+            } else {
+                // can't write to file (if any), swap
+                mapping->fwrite = mapping->hasfile = false;
+                mapping->swapped = true;
+                TRACE(TRACE_EVICT, mapping->page, "swap", 0);
+                swapped[swap_cnt] = mapping;
+                frames[swap_cnt] = frame;
+                pts[swap_cnt] = mapping->pt;
+                swap_cnt++;
+                continue;
+            }
+        } else {
+            TRACE(TRACE_EVICT, mapping->page, "nowhere", 0);
+        }
+
+        palloc_free_page(frame);
+        bin_sema_up(&mapping->lock);
     }
 
-    exit:
-    palloc_free_page(frame);
-    bin_sema_up(&mapping->lock);
+    swaptbl_store_batch(frames, pts, swapped, slots, swap_cnt);
+    for (size_t i = 0; i < swap_cnt; i++) {
+        swapped[i]->swap_slot = slots[i];
+        palloc_free_page(frames[i]);
+        bin_sema_up(&swapped[i]->lock);
+    }
 }
 
-/*! Clears out a page from the supplemental page table, making it no longer
-    accessible and flushing it to disk if it's backed by a file. Wipes the
-    supplemental page table entry. */
-void vm_clear_page(sup_pagetable_t *pt, void *upage) {
-    ASSERT(pg_ofs(upage) == 0);
-    ASSERT(is_user_vaddr(upage));
-
-    pagedir_clear_page(pt->pd, upage);
-    mapping_delete(pt, upage);
+/*! Instructs the supplemental PT to evict a user-space page UPAGE from its
+    frame. Requires that the page is pinned and frees it. */
+void vm_evict_page(vm_mapping_t *mapping) {
+    vm_evict_pages(&mapping, 1);
 }
 
 /*! Resets the accessed bit of a given page table entry and returns the original
@@ -372,35 +573,46 @@ bool vm_reset_accessed(vm_mapping_t *mapping) {
 }
 
 /*! Tries to resets the accessed bit of a given page table entry and returns the
-    original value. Returns -1 if the page is locked. */
+    original value. Returns -1 if the page is locked. The TLB is not flushed:
+    callers should call pagedir_flush_tlb() once they are done. */
 int vm_try_reset_accessed(vm_mapping_t *mapping) {
     if (mapping == NULL) return false;
     if (mapping->orphaned) return false;
     if (!bin_sema_try_down(&mapping->lock)) return -1;
-    bool a = pagedir_is_accessed(mapping->pt->pd, mapping->page);
-    pagedir_set_accessed(mapping->pt->pd, mapping->page, false);
+    bool a = pagedir_reset_accessed(mapping->pt->pd, mapping->page);
     bin_sema_up(&mapping->lock);
     return a;
 }
 
 /*! Pins n pages following upages, loading them into memory first if necessary.
-    Assumes that the pages are in the supplemental table and unpinned. */
-void vm_pin_pages(sup_pagetable_t *pt, const void *upages, size_t n) {
+    Assumes that the pages are unpinned. Returns false, with none of the pages
+    pinned, if any of them is not in the supplemental table or memory to load
+    it is not available. */
+bool vm_pin_pages(sup_pagetable_t *pt, const void *upages, size_t n) {
     for (size_t i = 0; i < n; i++) {
         void *upage = (void *) upages + i * PGSIZE;
-        vm_mapping_t *mapping = mapping_lookup(pt, upage);
-        ASSERT(mapping != NULL);
+        vm_mapping_t *mapping = mapping_get(pt, upage);
+        if (mapping == NULL) {
+            vm_unpin_pages(pt, upages, i);
+            return false;
+        }
         bin_sema_down(&mapping->lock);
         void *kpage = pagedir_get_page(pt->pd, upage);
-        if (kpage == NULL) {
-            _load_page(pt, upage, false);
+        if (kpage == NULL || mapping->zero) {
+            // the kernel may write to the page, so it can't stay shared
+            kpage = _load_page(pt, upage, true, false);
             bin_sema_up(&mapping->lock);
             // vm_load_page automatically pins the page, so we can move on.
+            if (kpage == NULL) {
+                vm_unpin_pages(pt, upages, i);
+                return false;
+            }
             continue;
         }
         ASSERT(frametbl_try_pin_frame(kpage));
         bin_sema_up(&mapping->lock);
     }
+    return true;
 }
 
 /*! Unpins n pages, following upages.
@@ -413,20 +625,83 @@ void vm_unpin_pages(sup_pagetable_t *pt, const void *upages, size_t n) {
     }
 }
 
+/*! Counts the pages of PT into *COUNTS. The counts are a snapshot, which
+    eviction may make stale at once. Must be called by the process which owns
+    PT, so that its regions do not change meanwhile. */
+void vm_count_pages(sup_pagetable_t *pt, vm_page_counts_t *counts) {
+    vm_region_t lookup = {.start = NULL};
+    avl_elem_t *elem;
+
+    memset(counts, 0, sizeof *counts);
+    while ((elem = avl_ceil(&pt->regions, &lookup.elem)) != NULL) {
+        vm_region_t *region = region_entry(elem);
+        counts->mapped += region->page_cnt;
+        for (list_elem_t *e = list_begin(&region->pages);
+             e != list_end(&region->pages); e = list_next(e)) {
+            vm_mapping_t *mapping = list_entry(e, vm_mapping_t, region_elem);
+            counts->touched++;
+            if (mapping->present) {
+                counts->present++;
+            } else if (mapping->zero) {
+                counts->zero++;
+            } else if (mapping->swapped) {
+                counts->swapped++;
+            }
+            if (mapping->hasfile) counts->file++;
+        }
+        lookup.start = region->start + 1;
+    }
+}
+
+/*! Gets the region from the embedded tree elem. */
+static vm_region_t *region_entry(const avl_elem_t *a) {
+    return avl_entry(a, vm_region_t, elem);
+}
+/*! Orders regions by address. */
+static bool region_less(const avl_elem_t *a, const avl_elem_t *b,
+                        void *aux UNUSED) {
+    return region_entry(a)->start < region_entry(b)->start;
+}
+
+/*! Frees a region by its tree element, closing the file it owns. Its pages
+    must have been destroyed already. */
+static void region_destroy(avl_elem_t *a, void *aux UNUSED) {
+    vm_region_t *region = region_entry(a);
+    if (region->fwrite) {
+        file_close(region->file);
+    }
+    kmem_cache_free(region_cache, region);
+}
+
+/*! Gets the region of the given page table which contains the address, or
+    NULL if there is none. */
+static vm_region_t *region_lookup(sup_pagetable_t *pt, const void *addr) {
+    vm_region_t lookup = {.start = (void *) addr};
+    avl_elem_t *elem = avl_floor(&pt->regions, &lookup.elem);
+    if (elem == NULL) {
+        return NULL;
+    }
+    vm_region_t *region = region_entry(elem);
+    if ((uintptr_t) (addr - region->start) >= region->page_cnt * PGSIZE) {
+        return NULL;
+    }
+    return region;
+}
+
 /*! Gets the map entry from the embedded hash elem. */
-static vm_mapping_t *map_entry(const hash_elem_t *a) {
-    return hash_entry(a, vm_mapping_t, elem);
+static vm_mapping_t *map_entry(const ihash_elem_t *a) {
+    return ihash_entry(a, vm_mapping_t, elem);
 }
 /*! Gets the virtual address from the element in the mapping. */
-static void *map_addr(const hash_elem_t *a) {
+static void *map_addr(const ihash_elem_t *a) {
     return map_entry(a)->page;
 }
 /*! Computes the hash of a mapping element. */
-static unsigned mapping_hash(const hash_elem_t *a, void *aux UNUSED) {
+static unsigned mapping_hash(const ihash_elem_t *a, void *aux UNUSED) {
     return hash_int((int) map_addr(a));
 }
 /*! Provides a total order on mapping element. */
-static bool mapping_less(const hash_elem_t *a, const hash_elem_t *b,
+static bool mapping_less(const ihash_elem_t *a, const ihash_elem_t *b,
                          void *aux UNUSED) {
     return map_addr(a) < map_addr(b);
 }
@@ -435,23 +710,20 @@ static bool mapping_less(const hash_elem_t *a, const hash_elem_t *b,
     mapping->lock. */
 static void mapping_free(vm_mapping_t *mapping) {
     ASSERT(mapping != NULL);
-    if (mapping->fwrite) {
-        file_close(mapping->data.file_info.file);
-    } 
     if (mapping->swapped && !mapping->present) {
-        swaptbl_load(NULL, mapping->data.swap_slot);
+        swaptbl_load(NULL, mapping->swap_slot);
     }
     if (mapping->present) {
         palloc_free_page(mapping->frame);
     }
     bin_sema_up(&mapping->lock);
-    free(mapping);
+    kmem_cache_free(mapping_cache, mapping);
 }
 
 /*! Releases a mapping by its hash element. If it has no physical memory,
     mapping_free is invoked immediately. If it has a physical frame, it is
     orphaned and mapping free is invoked when the frame is evicted. */
-static void mapping_destroy(hash_elem_t *a, void *aux UNUSED) {
+static void mapping_destroy(ihash_elem_t *a, void *aux UNUSED) {
     vm_mapping_t *mapping = map_entry(a);
     if (mapping == NULL) return;
     bin_sema_down(&mapping->lock);
@@ -474,17 +746,48 @@ static void mapping_destroy(hash_elem_t *a, void *aux UNUSED) {
 /*! Gets a vm_mapping_t struct for the given page table and address. */
 static vm_mapping_t *mapping_lookup(sup_pagetable_t *pt, const void *addr) {
     vm_mapping_t lookup = {.page = (void *) addr};
-    hash_elem_t *elem = hash_find(&pt->mappings, &lookup.elem);
+    ihash_elem_t *elem = ihash_find(&pt->mappings, &lookup.elem);
     if (elem == NULL) {
         return NULL;
     }
     return map_entry(elem);
 }
 
-/*! Removes a mapping from page tables hash map and invokes mapping_destroy. */
-static void mapping_delete(sup_pagetable_t *pt, const void *addr) {
-    vm_mapping_t lookup = {.page = (void *) addr};
-    hash_elem_t *elem = hash_delete(&pt->mappings, &lookup.elem);
-    ASSERT(elem != NULL);
-    mapping_destroy(elem, NULL);
-}
\ No newline at end of file
+/*! Gets the vm_mapping_t struct for the given page of the given page table,
+    creating it from the page's region if the page has not been touched
+    before. Returns NULL if the page is not mapped or memory allocation
+    fails. Only the thread running the process which owns PT may call this,
+    as nothing else modifies its mappings. */
+static vm_mapping_t *mapping_get(sup_pagetable_t *pt, const void *addr) {
+    vm_mapping_t *mapping = mapping_lookup(pt, addr);
+    if (mapping != NULL) {
+        return mapping;
+    }
+    vm_region_t *region = region_lookup(pt, addr);
+    if (region == NULL) {
+        return NULL;
+    }
+
+    // the lock is already constructed, and everything else is set here
+    mapping = kmem_cache_alloc(mapping_cache);
+    if (mapping == NULL) return NULL;
+    mapping->page = (void *) addr;
+    mapping->present = 0;
+    mapping->hasfile = 0;
+    mapping->fwrite = 0;
+    mapping->orphaned = 0;
+    mapping->swapped = 0;
+    mapping->zero = 0;
+    mapping->pt = pt;
+    mapping->region = region;
+    mapping->frame = NULL;
+    mapping->swap_slot = 0;
+    if (region->file != NULL
+        && (size_t) (addr - region->start) < region->file_bytes) {
+        mapping->hasfile = 1;
+        mapping->fwrite = region->fwrite;
+    }
+    ASSERT(ihash_insert(&pt->mappings, &mapping->elem) == NULL);
+    list_push_back(&region->pages, &mapping->region_elem);
+    return mapping;
+}
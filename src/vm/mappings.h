@@ -3,13 +3,19 @@
 
 #include <stdbool.h>
 #include <stdint.h>
-#include <hash.h>
+#include <avl.h>
+#include <ihash.h>
 #include "filesys/file.h"
 
-#define MAP_WRITE 0x1
-#define MAP_FWRITE 0x2
-#define MAP_START 0x4
-#define MAP_STACK 0x8
+/*! Flags for vm_map_region. @{ */
+#define MAP_WRITE 0x1   /*!< The region is writable. */
+#define MAP_FWRITE 0x2  /*!< Changes are written back to the file. */
+#define MAP_START 0x4   /*!< The region is a file mapping made by mmap. */
+#define MAP_STACK 0x8   /*!< The region is the stack, which may grow. */
+/*! @} */
+
+/*! Maximum number of pages evicted by a single call to vm_evict_pages. */
+#define VM_EVICT_MAX 8
 
 /*! Supplemental page directory. Represents a user process's view of memory:
     when a page fault occurs, the handler consults the supplemental page
@@ -19,12 +25,27 @@ typedef struct sup_pagetable {
                                  default kernel page table. */
     uint32_t *pd;       /*!< The hardware page directory, augmented using
                                  the available free bits. */
-    hash_t mappings;    /*!< Stores a mapping between addresses and files
-                                 for memory mapped files. */
+    avl_t regions;      /*!< Ranges of pages the user may access, ordered by
+                                 address. */
+    ihash_t mappings;   /*!< State of each page of the regions which has been
+                                 touched, by address. */
 } sup_pagetable_t;
 
 typedef struct vm_mapping vm_mapping_t;
 
+/*! Numbers of a page table's pages in each state. */
+typedef struct vm_page_counts {
+    size_t mapped;      /*!< Pages the user may access. */
+    size_t touched;     /*!< ...which have been accessed. */
+    size_t present;     /*!< ...which are in a frame of their own. */
+    size_t zero;        /*!< ...which share the zero frame. */
+    size_t swapped;     /*!< ...which are in swap. */
+    size_t file;        /*!< ...which are read from a file. */
+} vm_page_counts_t;
+
+void vm_init(void);
+struct frame *vm_zero_frame(void);
+
 bool sup_pt_create(sup_pagetable_t *pt);
 void sup_pt_destroy(sup_pagetable_t *pt);
 void sup_pt_activate(sup_pagetable_t *pt);
@@ -34,19 +55,19 @@ bool vm_page_is_mapped(sup_pagetable_t *pt, const void *upage);
 bool vm_page_is_writeable(sup_pagetable_t *pt, const void *upage);
 bool vm_page_is_mappable(sup_pagetable_t *pt, const void *upage);
 bool vm_page_is_stack(sup_pagetable_t *pt, const void *upage);
-bool vm_page_is_mapping_start(sup_pagetable_t *pt, const void *upage);
-void *vm_page_get_mapping_end(sup_pagetable_t *pt, const void *upage);
 
-bool vm_set_page(sup_pagetable_t *pt, void *upage, uint32_t flags,
-                     file_t *, off_t, size_t);
-bool vm_set_stack_page(sup_pagetable_t *pt, void *upage);
-struct frame *vm_load_page(sup_pagetable_t *pt, void *upage);
+bool vm_map_region(sup_pagetable_t *pt, void *upage, size_t page_cnt,
+                   uint32_t flags, file_t *, off_t, size_t file_bytes);
+bool vm_unmap_region(sup_pagetable_t *pt, void *upage);
+struct frame *vm_load_page(sup_pagetable_t *pt, void *upage, bool write);
 struct frame *vm_set_load_stack_page(sup_pagetable_t *pt, void *upage);
+struct frame *vm_grow_stack(sup_pagetable_t *pt, void *upage);
 void vm_evict_page(vm_mapping_t *);
-void vm_clear_page(sup_pagetable_t *pt, void *upage);
+void vm_evict_pages(vm_mapping_t **, size_t cnt);
 
-void vm_pin_pages(sup_pagetable_t *pt, const void *upages, size_t n);
+bool vm_pin_pages(sup_pagetable_t *pt, const void *upages, size_t n);
 void vm_unpin_pages(sup_pagetable_t *pt, const void *upages, size_t n);
+void vm_count_pages(sup_pagetable_t *pt, vm_page_counts_t *);
 
 bool vm_reset_accessed(vm_mapping_t *);
 int vm_try_reset_accessed(vm_mapping_t *mapping);
@@ -0,0 +1,344 @@
+/*! \file swapcache.c
+ *
+ * Compressed in-memory cache in front of the swap partition.
+ *
+ * Pages being swapped out are first offered to the cache. Pages which are
+ * filled with a single repeated word are kept as just that word; others are
+ * compressed with a small LZ77 variant and kept if they shrink enough. The
+ * cache is bounded by swapcache_pages pages of kernel memory; when it
+ * overflows, the least recently stored entries are written to the swap slots
+ * which were reserved for them. Slots therefore never change, so callers only
+ * ever deal with swap slot numbers.
+ *
+ * The lock only protects the cache's bookkeeping. Pages are compressed and
+ * decompressed in buffers of the caller's own, and entries being spilled are
+ * detached from the LRU list before they are written, so that threads
+ * swapping out at the same time do not wait on each other's disk writes.
+ */
+#include "vm/swapcache.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/swaptbl.h"
+
+/*! A page held by the cache. */
+typedef struct swapcache_entry {
+    list_elem_t elem;       /*!< Element in the LRU list, or in a list of
+                                 entries being spilled. */
+    uintptr_t slot;         /*!< Swap slot reserved for the page. */
+    bool spilling;          /*!< Being written to the slot. */
+    size_t size;            /*!< Bytes of compressed data, 0 if same-filled. */
+    uint32_t fill;          /*!< Repeated word, if same-filled. */
+    uint8_t data[];         /*!< Compressed data. */
+} swapcache_entry_t;
+
+/*! Largest compressed page which is kept. Entries are limited so that each
+    fits in one of malloc()'s 1 kB blocks rather than a whole page. */
+#define MAX_COMPRESSED (1024 - sizeof(swapcache_entry_t))
+
+/*! LZ parameters. Matches are encoded in two bytes: a 12 bit offset and a
+    4 bit length. @{ */
+#define LZ_HASH_BITS 10
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 15)
+/*! @} */
+
+/*! Maximum size of the cache in pages. 0 disables the cache. Set by the
+    -swapcache option. */
+size_t swapcache_pages = SWAPCACHE_DEFAULT_PAGES;
+
+/*! Scratch space for compressing a page, allocated by each store. It fits
+    in a page. */
+typedef struct lz_scratch {
+    uint16_t table[1 << LZ_HASH_BITS];  /*!< Last position of each hash. */
+    uint8_t buf[MAX_COMPRESSED];        /*!< Compressed data. */
+} lz_scratch_t;
+
+static swapcache_entry_t **entries;     /*!< Entry for each slot, or NULL. */
+static list_t lru;                      /*!< Entries not being spilled, oldest
+                                             first. */
+static size_t pool_bytes;               /*!< Memory used by entries on the
+                                             LRU list. */
+static lock_t lock;                     /*!< Protects everything above. */
+static condition_t spilled;             /*!< Signaled when entries have been
+                                             spilled. */
+static block_t *block;                  /*!< Swap device, for spilling. */
+
+/*! Page to spill through if no other page is available, and its lock. @{ */
+static void *spill_page;
+static lock_t spill_lock;
+/*! @} */
+
+/*! Statistics. @{ */
+static unsigned long long stored_cnt;   /*!< Pages taken by the cache. */
+static unsigned long long same_cnt;     /*!< ...of which were same-filled. */
+static unsigned long long reject_cnt;   /*!< Pages which didn't compress. */
+static unsigned long long hit_cnt;      /*!< Pages loaded from the cache. */
+static unsigned long long spill_cnt;    /*!< Pages spilled to the device. */
+static unsigned long long bytes_in;     /*!< Uncompressed bytes taken. */
+static unsigned long long bytes_out;    /*!< Compressed bytes kept. */
+/*! @} */
+
+/*! Initializes the cache in front of BLOCK, which has SLOT_CNT swap slots. */
+void swapcache_init(block_t *block_, size_t slot_cnt) {
+    block = block_;
+    lock_init(&lock);
+    lock_set_name(&lock, "swap cache");
+    cond_init(&spilled);
+    lock_init(&spill_lock);
+    list_init(&lru);
+    ASSERT(sizeof(lz_scratch_t) <= PGSIZE);
+    if (swapcache_pages == 0) return;
+    entries = calloc(slot_cnt, sizeof(swapcache_entry_t *));
+    spill_page = palloc_get_page(0);
+    if (entries == NULL || spill_page == NULL) {
+        printf("swapcache: out of memory, disabling\n");
+        free(entries);
+        palloc_free_page(spill_page);
+        entries = NULL;
+        swapcache_pages = 0;
+    }
+}
+
+/*! Hashes the LZ_MIN_MATCH bytes at P. */
+static inline unsigned lz_hash(const uint8_t *p) {
+    uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/*! Compresses the page at SRC into S's buffer. Returns the compressed size,
+    or 0 if it would exceed MAX_COMPRESSED bytes. */
+static size_t lz_compress(const uint8_t *src, lz_scratch_t *s) {
+    uint16_t *lz_table = s->table;
+    uint8_t *dst = s->buf;
+    const size_t max = MAX_COMPRESSED;
+    size_t in = 0, out = 0;
+
+    memset(s->table, 0, sizeof s->table);
+    while (in < PGSIZE) {
+        // Room for a control byte and eight matches.
+        if (out + 1 + 8 * 2 > max) return 0;
+        uint8_t *ctrl = &dst[out++];
+        *ctrl = 0;
+        for (int bit = 0; bit < 8 && in < PGSIZE; bit++) {
+            size_t len = 0, off = 0;
+            if (in + LZ_MIN_MATCH <= PGSIZE) {
+                unsigned h = lz_hash(src + in);
+                size_t cand = lz_table[h];
+                lz_table[h] = in + 1;
+                if (cand != 0) {
+                    const uint8_t *p = src + cand - 1;
+                    off = in - (cand - 1);
+                    while (len < LZ_MAX_MATCH && in + len < PGSIZE
+                           && p[len] == src[in + len]) {
+                        len++;
+                    }
+                }
+            }
+            if (len >= LZ_MIN_MATCH) {
+                *ctrl |= 1 << bit;
+                dst[out++] = off & 0xff;
+                dst[out++] = ((off >> 8) & 0x0f) | ((len - LZ_MIN_MATCH) << 4);
+                in += len;
+            } else {
+                dst[out++] = src[in++];
+            }
+        }
+    }
+    return out;
+}
+
+/*! Decompresses the SIZE bytes at SRC into the page at DST. */
+static void lz_decompress(const uint8_t *src, size_t size, uint8_t *dst) {
+    size_t in = 0, out = 0;
+
+    while (in < size) {
+        uint8_t ctrl = src[in++];
+        for (int bit = 0; bit < 8 && in < size; bit++) {
+            if (ctrl & (1 << bit)) {
+                size_t off = src[in] | ((src[in + 1] & 0x0f) << 8);
+                size_t len = (src[in + 1] >> 4) + LZ_MIN_MATCH;
+                in += 2;
+                for (; len > 0; len--, out++) {
+                    dst[out] = dst[out - off];
+                }
+            } else {
+                dst[out++] = src[in++];
+            }
+        }
+    }
+    ASSERT(out == PGSIZE);
+}
+
+/*! Returns true if the page at PAGE consists of a single repeated word, which
+    is stored into FILL. */
+static bool same_filled(const void *page, uint32_t *fill) {
+    const uint32_t *words = page;
+    for (size_t i = 1; i < PGSIZE / sizeof(uint32_t); i++) {
+        if (words[i] != words[0]) return false;
+    }
+    *fill = words[0];
+    return true;
+}
+
+/*! Writes ENTRY's page to PAGE. */
+static void entry_unpack(swapcache_entry_t *entry, void *page) {
+    if (entry->size == 0) {
+        uint32_t *words = page;
+        for (size_t i = 0; i < PGSIZE / sizeof(uint32_t); i++) {
+            words[i] = entry->fill;
+        }
+    } else {
+        lz_decompress(entry->data, entry->size, page);
+    }
+}
+
+/*! Returns the memory malloc() uses for an entry with SIZE bytes of data,
+    rounding up to its block size, a power of 2 of at least 16 bytes. */
+static size_t entry_bytes(size_t size) {
+    size_t bytes = 16;
+    while (bytes < sizeof(swapcache_entry_t) + size) bytes *= 2;
+    return bytes;
+}
+
+/*! Takes ENTRY, which is not being spilled, off the LRU list. Must hold the
+    lock. */
+static void entry_detach(swapcache_entry_t *entry) {
+    list_remove(&entry->elem);
+    pool_bytes -= entry_bytes(entry->size);
+}
+
+/*! Writes the entries on SPILLS to their swap slots, then removes them from
+    the cache. Must not hold the lock; loads of the slots meanwhile wait until
+    the pages are on the device. */
+static void spill(list_t *spills) {
+    void *page = palloc_get_page(0);
+    if (page == NULL) {
+        lock_acquire(&spill_lock);
+    }
+    for (list_elem_t *e = list_begin(spills); e != list_end(spills);
+         e = list_next(e)) {
+        swapcache_entry_t *entry = list_entry(e, swapcache_entry_t, elem);
+        entry_unpack(entry, page != NULL ? page : spill_page);
+        block_write_multiple(block, entry->slot * SECTORS_PER_PAGE,
+                             SECTORS_PER_PAGE,
+                             page != NULL ? page : spill_page);
+    }
+    if (page != NULL) {
+        palloc_free_page(page);
+    } else {
+        lock_release(&spill_lock);
+    }
+
+    lock_acquire(&lock);
+    while (!list_empty(spills)) {
+        swapcache_entry_t *entry = list_entry(list_pop_front(spills),
+                                              swapcache_entry_t, elem);
+        entries[entry->slot] = NULL;
+        free(entry);
+        spill_cnt++;
+    }
+    cond_broadcast(&spilled, &lock);
+    lock_release(&lock);
+}
+
+/*! Offers PAGE, which is being swapped out to SLOT, to the cache. Returns true
+    if the cache took it, in which case it must not be written to the device;
+    false if it should be written to the device as usual. */
+bool swapcache_store(uintptr_t slot, const void *page) {
+    if (swapcache_pages == 0) return false;
+
+    uint32_t fill = 0;
+    size_t size = 0;
+    lz_scratch_t *scratch = NULL;
+    if (!same_filled(page, &fill)) {
+        scratch = palloc_get_page(0);
+        if (scratch == NULL) return false;
+        size = lz_compress(page, scratch);
+        if (size == 0) {
+            palloc_free_page(scratch);
+            lock_acquire(&lock);
+            reject_cnt++;
+            lock_release(&lock);
+            return false;
+        }
+    }
+
+    swapcache_entry_t *entry = malloc(sizeof(swapcache_entry_t) + size);
+    if (entry == NULL) {
+        palloc_free_page(scratch);
+        return false;
+    }
+    entry->slot = slot;
+    entry->spilling = false;
+    entry->size = size;
+    entry->fill = fill;
+    if (scratch != NULL) {
+        memcpy(entry->data, scratch->buf, size);
+        palloc_free_page(scratch);
+    }
+
+    list_t spills;
+    list_init(&spills);
+    lock_acquire(&lock);
+    ASSERT(entries[slot] == NULL);
+    entries[slot] = entry;
+    list_push_back(&lru, &entry->elem);
+    pool_bytes += entry_bytes(size);
+
+    stored_cnt++;
+    same_cnt += size == 0;
+    bytes_in += PGSIZE;
+    bytes_out += size == 0 ? sizeof(fill) : size;
+
+    // Detach the oldest entries to bring the cache within its bound.
+    while (pool_bytes > swapcache_pages * PGSIZE && !list_empty(&lru)) {
+        swapcache_entry_t *old = list_entry(list_front(&lru),
+                                            swapcache_entry_t, elem);
+        entry_detach(old);
+        old->spilling = true;
+        list_push_back(&spills, &old->elem);
+    }
+    lock_release(&lock);
+
+    if (!list_empty(&spills)) spill(&spills);
+    return true;
+}
+
+/*! If the page swapped out to SLOT is in the cache, writes it to PAGE, drops
+    it from the cache and returns true. Otherwise returns false and the page
+    must be read from the device. If PAGE is NULL, only drops the page. */
+bool swapcache_load(uintptr_t slot, void *page) {
+    if (entries == NULL) return false;
+
+    lock_acquire(&lock);
+    swapcache_entry_t *entry;
+    while ((entry = entries[slot]) != NULL && entry->spilling) {
+        cond_wait(&spilled, &lock);
+    }
+    if (entry != NULL) {
+        entries[slot] = NULL;
+        entry_detach(entry);
+        hit_cnt += page != NULL;
+    }
+    lock_release(&lock);
+
+    if (entry == NULL) return false;
+    if (page != NULL) entry_unpack(entry, page);
+    free(entry);
+    return true;
+}
+
+/*! Prints swap cache statistics. */
+void swapcache_print_stats(void) {
+    unsigned long long ratio = bytes_out == 0 ? 0 : bytes_in * 100 / bytes_out;
+    printf("Swap cache: %llu pages stored (%llu same-filled), %llu rejected, "
+           "%llu hits, %llu spilled, %llu.%02llu:1 compression\n",
+           stored_cnt, same_cnt, reject_cnt, hit_cnt, spill_cnt,
+           ratio / 100, ratio % 100);
+}
@@ -0,0 +1,19 @@
+#ifndef VM_SWAPCACHE_H
+#define VM_SWAPCACHE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/*! Default size of the compressed swap cache, in pages. */
+#define SWAPCACHE_DEFAULT_PAGES 32
+
+extern size_t swapcache_pages;
+
+void swapcache_init(block_t *block, size_t slot_cnt);
+bool swapcache_store(uintptr_t slot, const void *page);
+bool swapcache_load(uintptr_t slot, void *page);
+void swapcache_print_stats(void);
+
+#endif /* vm/swapcache.h */
@@ -1,19 +1,34 @@
 #include <bitmap.h>
 #include "devices/block.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "threads/palloc.h"
 
 #include "swaptbl.h"
+#include "swapcache.h"
 
-#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 #define MAX_SWAP_SIZE UINTPTR_MAX
 
-/*! Bitmap tracking which slots of the swap table are currently occupied. 
-    After swaptbl_store returns X, bit X is true, and once swaptbl_load is given
-    X, bit X will be false. */
+/*! The page which was swapped into a slot, so that neighbouring slots can be
+    read ahead on behalf of the process which owns them. */
+typedef struct swap_owner {
+    sup_pagetable_t *pt;    /*!< Page table of the owning process. */
+    vm_mapping_t *mapping;  /*!< Mapping whose contents are in the slot. */
+} swap_owner_t;
+
+/*! Bitmap tracking which slots of the swap table are currently occupied.
+    After swaptbl_store_batch hands out X, bit X is true, and once swaptbl_load
+    is given X, bit X will be false. */
 static bitmap_t *occupied;
-/*! Lock to ensure the operation of finding and claiming a swap slot is atomic. */
+/*! Owner of each occupied slot. */
+static swap_owner_t *owners;
+/*! Slot at which the next search for free slots starts, so that consecutive
+    stores land in adjacent slots. */
+static size_t next_slot;
+/*! Lock to ensure the operation of finding and claiming a swap slot is atomic.
+    It is not held during I/O: a claimed slot belongs to its page until it is
+    released by swaptbl_load. */
 static lock_t lock;
 /*! The swap partition block device. */
 static block_t *block;
@@ -22,6 +37,7 @@ static block_t *block;
     swap, this function will panic on failure. */
 void swaptbl_init(void) {
     lock_init(&lock);
+    lock_set_name(&lock, "swap table");
     block = block_get_role(BLOCK_SWAP);
     ASSERT(block != NULL);
     size_t swap_slots = block_size(block) / SECTORS_PER_PAGE;
@@ -30,46 +46,159 @@ void swaptbl_init(void) {
     }
     occupied = bitmap_create(swap_slots);
     ASSERT(occupied != NULL);
+    if (!bitmap_enable_summary(occupied)) {
+        PANIC("swap table summary allocation failed");
+    }
+    owners = calloc(swap_slots, sizeof(swap_owner_t));
+    ASSERT(owners != NULL);
+    swapcache_init(block, swap_slots);
+}
+
+/*! Claims CNT free slots, writing them to SLOTS. The slots are adjacent if
+    such a run is available. Must be called with the lock held. Panics if there
+    are not enough slots. */
+static void claim_slots(uintptr_t *slots, size_t cnt) {
+    size_t first = bitmap_scan_and_flip(occupied, next_slot, cnt, false);
+    if (first == BITMAP_ERROR) {
+        first = bitmap_scan_and_flip(occupied, 0, cnt, false);
+    }
+    if (first != BITMAP_ERROR) {
+        for (size_t i = 0; i < cnt; i++) {
+            slots[i] = first + i;
+        }
+    } else {
+        // No run is long enough, so scatter the pages.
+        for (size_t i = 0; i < cnt; i++) {
+            slots[i] = bitmap_scan_and_flip(occupied, 0, 1, false);
+            if (slots[i] == BITMAP_ERROR) {
+                PANIC("Ran out of swap space, panic!\n");
+            }
+        }
+    }
+    next_slot = (slots[cnt - 1] + 1) % bitmap_size(occupied);
+}
+
+/*! Transfers the CNT pages in PAGES to or from the adjacent slots starting
+    at FIRST, writing if WRITE is true and reading otherwise. The device sees
+    a single request, which moves each page directly to or from its frame. */
+static void transfer_run(void **pages, uintptr_t first, size_t cnt,
+                         bool write) {
+    block_sector_t sector = first * SECTORS_PER_PAGE;
+
+    if (write)
+        block_write_vector(block, sector, cnt, SECTORS_PER_PAGE,
+                           (const void *const *) pages);
+    else
+        block_read_vector(block, sector, cnt, SECTORS_PER_PAGE, pages);
+}
+
+/*! Transfers the CNT pages in PAGES to or from SLOTS, skipping those whose
+    entry in DONE is true, with one transfer per run of adjacent slots. */
+static void transfer_pages(void **pages, const uintptr_t *slots,
+                           const bool *done, size_t cnt, bool write) {
+    void *run[SWAP_BATCH_MAX];
+    size_t i = 0;
+
+    while (i < cnt) {
+        if (done[i]) {
+            i++;
+            continue;
+        }
+        size_t len = 0;
+        uintptr_t first = slots[i];
+        do {
+            run[len++] = pages[i++];
+        } while (i < cnt && !done[i] && slots[i] == first + len);
+        transfer_run(run, first, len, write);
+    }
 }
 
-/*! Writes the given page to a free swap slot and returns the index of swap slot
-    to be passed to swaptbl_load. Page passed in must be a valid address and
-    should be pinned. Panics if there are no slots available.
+/*! Writes the CNT pages in PAGES to free swap slots, as adjacent to each
+    other as possible, or to the compressed swap cache, and stores the index
+    of each page's slot in SLOTS, to be passed to swaptbl_load. Each run of
+    adjacent slots is written with a single transfer. PTS and MAPPINGS
+    identify the owner of each page for read-ahead. Pages passed in must be
+    valid addresses and should be pinned. Panics if there are not enough
+    slots available. CNT may be at most SWAP_BATCH_MAX.
+
+    The top PGBITS bits of each slot are guaranteed to be 0. */
+void swaptbl_store_batch(void **pages, sup_pagetable_t **pts,
+                         vm_mapping_t **mappings, uintptr_t *slots,
+                         size_t cnt) {
+    bool cached[SWAP_BATCH_MAX];
 
-    The top PGBITS bits are guaranteed to be 0. */
-uintptr_t swaptbl_store(void *page) {
-    ASSERT(pg_ofs(page) == 0);
-    ASSERT(page > PHYS_BASE);
+    ASSERT(cnt <= SWAP_BATCH_MAX);
+    if (cnt == 0) return;
     lock_acquire(&lock);
-    size_t slot = bitmap_lowest(occupied, false);
-    if (slot == BITMAP_ERROR) {
-        PANIC("Ran out of swap space, panic!\n");
+    claim_slots(slots, cnt);
+    for (size_t i = 0; i < cnt; i++) {
+        owners[slots[i]].pt = pts[i];
+        owners[slots[i]].mapping = mappings[i];
     }
-    bitmap_set(occupied, slot, true);
-    for (block_sector_t sec = slot * SECTORS_PER_PAGE;
-         sec < (slot + 1) * SECTORS_PER_PAGE; sec++) {
-        size_t off = (sec - slot * SECTORS_PER_PAGE) * BLOCK_SECTOR_SIZE;
-        block_write(block, sec, page + off);
+    lock_release(&lock);
+
+    for (size_t i = 0; i < cnt; i++) {
+        ASSERT(pg_ofs(pages[i]) == 0);
+        ASSERT(pages[i] > PHYS_BASE);
+        cached[i] = swapcache_store(slots[i], pages[i]);
+    }
+    transfer_pages(pages, slots, cached, cnt, true);
+}
+
+/*! Reads the contents of the CNT slots in SLOTS into the corresponding
+    PAGES and marks the slots as free, with one transfer per run of adjacent
+    slots. Panics if any slot is not currently occupied. CNT may be at most
+    SWAP_BATCH_MAX. */
+void swaptbl_load_batch(void **pages, const uintptr_t *slots, size_t cnt) {
+    bool cached[SWAP_BATCH_MAX];
+
+    ASSERT(cnt <= SWAP_BATCH_MAX);
+    for (size_t i = 0; i < cnt; i++) {
+        ASSERT(slots[i] < bitmap_size(occupied)
+               && bitmap_test(occupied, slots[i]));
+        ASSERT(pg_ofs(pages[i]) == 0);
+        ASSERT(pages[i] > PHYS_BASE);
+        cached[i] = swapcache_load(slots[i], pages[i]);
+    }
+    transfer_pages(pages, slots, cached, cnt, false);
+
+    lock_acquire(&lock);
+    for (size_t i = 0; i < cnt; i++) {
+        owners[slots[i]].pt = NULL;
+        owners[slots[i]].mapping = NULL;
+        bitmap_set(occupied, slots[i], false);
     }
     lock_release(&lock);
-    return slot;
 }
 
 /*! Reads the contents of the slot at slot into the given page and marks the
     slot as free. Panics if the given swap slot is not currently occupied.
     If page is NULL, marks the slot as free. */
 void swaptbl_load(void *page, uintptr_t slot) {
-    lock_acquire(&lock);
-    if (page == NULL) goto exit;
-    ASSERT(pg_ofs(page) == 0);
-    ASSERT(page > PHYS_BASE);
-    for (block_sector_t sec = slot * SECTORS_PER_PAGE;
-         sec < (slot + 1) * SECTORS_PER_PAGE; sec++) {
-        size_t off = (sec - slot * SECTORS_PER_PAGE) * BLOCK_SECTOR_SIZE;
-        block_read(block, sec, page + off);
+    if (page != NULL) {
+        swaptbl_load_batch(&page, &slot, 1);
+        return;
     }
-    exit:
     ASSERT(slot < bitmap_size(occupied) && bitmap_test(occupied, slot));
+    swapcache_load(slot, NULL);
+    lock_acquire(&lock);
+    owners[slot].pt = NULL;
+    owners[slot].mapping = NULL;
     bitmap_set(occupied, slot, false);
     lock_release(&lock);
-}
\ No newline at end of file
+}
+
+/*! Returns the mapping whose contents are in SLOT if the slot is occupied and
+    belongs to PT, otherwise NULL. Only the thread running the process which
+    owns PT may call this with PT, as nothing else frees its unloaded
+    mappings. */
+vm_mapping_t *swaptbl_owner(uintptr_t slot, sup_pagetable_t *pt) {
+    vm_mapping_t *mapping = NULL;
+    lock_acquire(&lock);
+    if (slot < bitmap_size(occupied) && bitmap_test(occupied, slot)
+        && owners[slot].pt == pt) {
+        mapping = owners[slot].mapping;
+    }
+    lock_release(&lock);
+    return mapping;
+}
@@ -2,10 +2,24 @@
 #define VM_SWAPTBL_H
 
 #include <inttypes.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "threads/vaddr.h"
+#include "vm/mappings.h"
+
+/*! Number of device sectors in a swap slot. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/*! Most pages stored or loaded by one batch. */
+#define SWAP_BATCH_MAX 16
 
 void swaptbl_init(void);
 
-uintptr_t swaptbl_store(void *page);
+void swaptbl_store_batch(void **pages, sup_pagetable_t **pts,
+                         vm_mapping_t **mappings, uintptr_t *slots,
+                         size_t cnt);
 void swaptbl_load(void *page, uintptr_t swapidx);
+void swaptbl_load_batch(void **pages, const uintptr_t *slots, size_t cnt);
+vm_mapping_t *swaptbl_owner(uintptr_t slot, sup_pagetable_t *pt);
 
 #endif
\ No newline at end of file